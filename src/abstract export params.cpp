@@ -96,6 +96,7 @@ ExportParams exportFrameParams(const ExportAnimationInfo &info, const QString &p
   setFormat(params, info);
   params.generator = std::make_unique<PngAtlasGenerator>();
   params.whitepixel = false;
+  params.trim = false;
   return params;
 }
 
@@ -110,5 +111,6 @@ ExportParams exportCelParams(const ExportAnimationInfo &info, const QString &pat
   setFormat(params, info);
   params.generator = std::make_unique<PngAtlasGenerator>();
   params.whitepixel = false;
+  params.trim = false;
   return params;
 }
@@ -13,13 +13,15 @@
 #include "chunk io.hpp"
 #include "cel array.hpp"
 #include "scope time.hpp"
+#include <iostream>
+#include <QtCore/qendian.h>
 #include <Graphics/format.hpp>
 
 namespace {
 
 Bytef *getImageRowBuffer(const std::size_t newSize) {
-  static std::unique_ptr<Bytef[]> buffer;
-  static std::size_t size = 0;
+  thread_local std::unique_ptr<Bytef[]> buffer;
+  thread_local std::size_t size = 0;
   if (size < newSize) {
     // TODO: std::make_unique_for_overwrite
     buffer = std::unique_ptr<Bytef[]>{new Bytef[newSize]};
@@ -43,6 +45,97 @@ constexpr std::uint8_t formatByte(const Format format) {
   return byteDepth(format);
 }
 
+int zlibStrategy(const CelStrategy strategy) {
+  switch (strategy) {
+    case CelStrategy::normal:
+      return Z_DEFAULT_STRATEGY;
+    case CelStrategy::rle:
+      return Z_RLE;
+  }
+}
+
+enum : std::uint8_t {
+  filter_none,
+  filter_sub,
+  filter_up,
+  filter_average,
+  filter_paeth,
+  filter_count
+};
+
+int paethPredictor(const int a, const int b, const int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  if (pb <= pc) return b;
+  return c;
+}
+
+// a is the byte to the left, b is the byte above and c is the byte above and
+// to the left. Bytes outside of the image are zero.
+int predict(
+  const std::uint8_t type,
+  const Bytef *row,
+  const Bytef *prev,
+  const uInt i,
+  const int depth
+) {
+  const bool first = i < static_cast<uInt>(depth);
+  const int a = first ? 0 : row[i - depth];
+  const int b = prev[i];
+  const int c = first ? 0 : prev[i - depth];
+  switch (type) {
+    case filter_sub:
+      return a;
+    case filter_up:
+      return b;
+    case filter_average:
+      return (a + b) / 2;
+    case filter_paeth:
+      return paethPredictor(a, b, c);
+    default:
+      return 0;
+  }
+}
+
+// Filters a row with the filter type that minimizes the sum of the absolute
+// values of the filtered bytes. This is the heuristic recommended by PNG.
+void filterRow(Bytef *dst, const Bytef *row, const Bytef *prev, const uInt size, const int depth) {
+  SCOPE_TIME("filterRow");
+  
+  std::uint8_t bestType = filter_none;
+  std::uint64_t bestSum = ~std::uint64_t{};
+  for (std::uint8_t type = filter_none; type != filter_count; ++type) {
+    std::uint64_t sum = 0;
+    for (uInt i = 0; i != size; ++i) {
+      const auto filtered = static_cast<std::int8_t>(row[i] - predict(type, row, prev, i, depth));
+      sum += std::abs(filtered);
+    }
+    if (sum < bestSum) {
+      bestType = type;
+      bestSum = sum;
+    }
+  }
+  
+  dst[0] = bestType;
+  for (uInt i = 0; i != size; ++i) {
+    dst[i + 1] = static_cast<Bytef>(row[i] - predict(bestType, row, prev, i, depth));
+  }
+}
+
+Error unfilterRow(Bytef *row, const Bytef *src, const Bytef *prev, const uInt size, const int depth) {
+  const std::uint8_t type = src[0];
+  if (type >= filter_count) {
+    return "Invalid scanline filter " + QString::number(type);
+  }
+  for (uInt i = 0; i != size; ++i) {
+    row[i] = static_cast<Bytef>(src[i + 1] + predict(type, row, prev, i, depth));
+  }
+  return {};
+}
+
 template <typename DstFmt, typename SrcFmt>
 void alignedCopy(unsigned char *dstBytes, const unsigned char *srcBytes, const std::size_t size) {
   using DstPixel = typename DstFmt::Pixel;
@@ -125,8 +218,10 @@ Error writeSignature(QIODevice &dev) {
 Error writeAHDR(QIODevice &dev, const AnimationInfo &info) try {
   SCOPE_TIME("writeAHDR");
 
+  // The filter byte is only written when it's needed so that files that don't
+  // use it can still be read by older versions
   ChunkWriter writer{dev};
-  writer.begin(6 * file_int_size + 1, chunk_anim_header);
+  writer.begin(6 * file_int_size + 1 + info.filter, chunk_anim_header);
   writer.writeInt(info.width);
   writer.writeInt(info.height);
   writer.writeInt(static_cast<std::uint32_t>(info.layers));
@@ -134,6 +229,7 @@ Error writeAHDR(QIODevice &dev, const AnimationInfo &info) try {
   writer.writeInt(static_cast<std::uint32_t>(info.frames));
   writer.writeInt(info.delay);
   writer.writeByte(formatByte(info.format));
+  if (info.filter) writer.writeByte(1);
   writer.end();
   return {};
 } catch (FileIOError &e) {
@@ -191,8 +287,13 @@ Error writePLTE(QIODevice &dev, const PaletteCSpan colors, const Format format)
 Error writeGRPS(QIODevice &dev, const std::vector<Group> &groups) try {
   SCOPE_TIME("writeGRPS");
   
+  std::uint32_t length = 0;
+  for (const Group &group : groups) {
+    length += 2 * file_int_size + static_cast<std::uint32_t>(group.name.size());
+  }
+  
   ChunkWriter writer{dev};
-  writer.begin(chunk_groups);
+  writer.begin(length, chunk_groups);
   FrameIdx prevEnd{};
   
   for (const Group &group : groups) {
@@ -228,8 +329,11 @@ Error writeLHDR(QIODevice &dev, const Layer &layer) try {
 Error writeCHDR(QIODevice &dev, const Cel &cel) try {
   SCOPE_TIME("writeCHDR");
 
+  std::uint32_t length = file_int_size;
+  if (*cel.cel) length += 4 * file_int_size;
+
   ChunkWriter writer{dev};
-  writer.begin(chunk_cel_header);
+  writer.begin(length, chunk_cel_header);
   writer.writeInt(static_cast<std::uint32_t>(cel.len));
   if (*cel.cel) {
     const QRect rect = cel.cel->rect();
@@ -250,15 +354,27 @@ struct CompressContext {
   ChunkWriter &writer;
   const QImage &image;
   Bytef *inBuff;
-  uInt inBuffSize;
+  Bytef *rowBuff;
+  Bytef *prevBuff;
+  uInt rowSize;
   Format format;
+  bool filter;
   std::uint32_t remainingChunk = ~std::uint32_t{};
   int rowIdx = 0;
   
-  CompressContext(ChunkWriter &writer, const QImage &image, const Format format)
-    : writer{writer}, image{image}, format{format} {
-    inBuffSize = image.width() * byteDepth(format);
-    inBuff = getImageRowBuffer(inBuffSize);
+  CompressContext(ChunkWriter &writer, const QImage &image, const Format format, const bool filter)
+    : writer{writer}, image{image}, format{format}, filter{filter} {
+    rowSize = image.width() * byteDepth(format);
+    if (filter) {
+      // Filtering needs the previous row and room for the filter type byte
+      rowBuff = getImageRowBuffer(3 * rowSize + 1);
+      prevBuff = rowBuff + rowSize;
+      inBuff = prevBuff + rowSize;
+      std::memset(prevBuff, 0, rowSize);
+    } else {
+      inBuff = rowBuff = getImageRowBuffer(rowSize);
+      prevBuff = nullptr;
+    }
   }
   
   bool hasInput() const {
@@ -266,8 +382,11 @@ struct CompressContext {
   }
   
   std::pair<const Bytef *, uInt> getInputBuffer() {
-    copyToByteOrder(inBuff, image.scanLine(rowIdx++), inBuffSize, format);
-    return {inBuff, inBuffSize};
+    copyToByteOrder(rowBuff, image.scanLine(rowIdx++), rowSize, format);
+    if (!filter) return {inBuff, rowSize};
+    filterRow(inBuff, rowBuff, prevBuff, rowSize, byteDepth(format));
+    std::swap(rowBuff, prevBuff);
+    return {inBuff, rowSize + 1};
   }
   
   Error processOutputBuffer(const Bytef *dat, const uInt len) {
@@ -281,7 +400,12 @@ struct CompressContext {
 
 }
 
-Error writeCDAT(QIODevice &dev, const QImage &image, const Format format) try {
+Error writeCDAT(
+  QIODevice &dev,
+  const QImage &image,
+  const Format format,
+  const CelCompression &compression
+) try {
   SCOPE_TIME("writeCDAT");
   
   static_assert(sizeof(uInt) >= sizeof(std::uint32_t));
@@ -290,10 +414,63 @@ Error writeCDAT(QIODevice &dev, const QImage &image, const Format format) try {
   
   ChunkWriter writer{dev};
   writer.begin(chunk_cel_data);
-  CompressContext context{writer, image, format};
-  TRY(zlibCompress(context));
+  CompressContext context{writer, image, format, compression.filter};
+  TRY(zlibCompress(context, false, compression.level, zlibStrategy(compression.strategy)));
+  writer.end();
+  
+  return {};
+} catch (FileIOError &e) {
+  return e.msg();
+}
+
+Error writeCDAT(QIODevice &dev, const QByteArray &chunk) {
+  SCOPE_TIME("writeCDAT");
+  
+  if (dev.write(chunk) != chunk.size()) {
+    return dev.errorString();
+  }
+  return {};
+}
+
+Error writeCREF(QIODevice &dev, const std::uint32_t ref) try {
+  SCOPE_TIME("writeCREF");
+  
+  ChunkWriter writer{dev};
+  writer.begin(file_int_size, chunk_cel_reference);
+  writer.writeInt(ref);
   writer.end();
+  return {};
+} catch (FileIOError &e) {
+  return e.msg();
+}
+
+Error writeINDX(QIODevice &dev, const std::vector<LayerIndex> &index) try {
+  SCOPE_TIME("writeINDX");
   
+  // The index chunk itself is the last chunk to be written so if its offset
+  // fits then all of the others do too. Large files don't get an index.
+  const qint64 indexPos = dev.pos();
+  if (indexPos > qint64{~std::uint32_t{}}) return {};
+  
+  std::uint32_t length = file_int_size;
+  for (const LayerIndex &layer : index) {
+    length += 2 * file_int_size;
+    length += 3 * file_int_size * static_cast<std::uint32_t>(layer.cels.size());
+  }
+  
+  ChunkWriter writer{dev};
+  writer.begin(length, chunk_index);
+  for (const LayerIndex &layer : index) {
+    writer.writeInt(static_cast<std::uint32_t>(layer.header));
+    writer.writeInt(static_cast<std::uint32_t>(layer.cels.size()));
+    for (const CelIndex &cel : layer.cels) {
+      writer.writeInt(static_cast<std::uint32_t>(cel.frame));
+      writer.writeInt(static_cast<std::uint32_t>(cel.header));
+      writer.writeInt(static_cast<std::uint32_t>(cel.data));
+    }
+  }
+  writer.writeInt(static_cast<std::uint32_t>(indexPos));
+  writer.end();
   return {};
 } catch (FileIOError &e) {
   return e.msg();
@@ -350,7 +527,7 @@ Error readAHDR(QIODevice &dev, AnimationInfo &info) try {
   ChunkReader reader{dev};
   const ChunkStart start = reader.begin();
   TRY(expectedName(start, chunk_anim_header));
-  if (start.length != 6 * file_int_size + 1) {
+  if (start.length != 6 * file_int_size + 1 && start.length != 6 * file_int_size + 2) {
     return chunkLengthInvalid(start);
   }
   
@@ -361,6 +538,10 @@ Error readAHDR(QIODevice &dev, AnimationInfo &info) try {
   info.frames = static_cast<FrameIdx>(reader.readInt());
   info.delay = reader.readInt();
   const std::uint8_t format = reader.readByte();
+  std::uint8_t filter = 0;
+  if (start.length == 6 * file_int_size + 2) {
+    filter = reader.readByte();
+  }
   
   TRY(reader.end());
   
@@ -377,6 +558,8 @@ Error readAHDR(QIODevice &dev, AnimationInfo &info) try {
     return "Animation delay is out-of-range";
   }
   TRY(readFormatByte(info.format, format));
+  if (filter > 1) return "Invalid cel filter method " + QString::number(filter);
+  info.filter = filter;
   
   return {};
 } catch (FileIOError &e) {
@@ -612,25 +795,42 @@ Error readCHDR(QIODevice &dev, Cel &cel, const Format format) try {
 namespace {
 
 struct DecompressContext {
-  ChunkReader &reader;
+  const Bytef *inBuff;
   QImage &image;
   std::uint32_t remainingChunk;
   Bytef *outBuff;
+  Bytef *rowBuff;
+  Bytef *prevBuff;
   uInt outBuffSize;
+  uInt rowSize;
   int rowIdx = 0;
   Format format;
+  bool filter;
   
   DecompressContext(
-    ChunkReader &reader,
+    const Bytef *inBuff,
     QImage &image,
     const Format format,
+    const bool filter,
     const std::uint32_t remainingChunk
-  ) : reader{reader},
+  ) : inBuff{inBuff},
       image{image},
       remainingChunk{remainingChunk},
-      format{format} {
-    outBuffSize = image.width() * byteDepth(format);
-    outBuff = getImageRowBuffer(outBuffSize);
+      format{format},
+      filter{filter} {
+    rowSize = image.width() * byteDepth(format);
+    if (filter) {
+      // Each row begins with a filter type byte
+      outBuffSize = rowSize + 1;
+      rowBuff = getImageRowBuffer(3 * rowSize + 1);
+      prevBuff = rowBuff + rowSize;
+      outBuff = prevBuff + rowSize;
+      std::memset(prevBuff, 0, rowSize);
+    } else {
+      outBuffSize = rowSize;
+      outBuff = rowBuff = getImageRowBuffer(rowSize);
+      prevBuff = nullptr;
+    }
   }
   
   bool hasInput() const {
@@ -645,43 +845,234 @@ struct DecompressContext {
     return rowIdx == image.height() - 1;
   }
   
-  uInt fillInputBuffer(Bytef *dat, uInt len) {
-    len = std::min(len, remainingChunk);
-    remainingChunk -= len;
-    reader.readString(dat, len);
-    return len;
+  std::pair<const Bytef *, uInt> getInputBuffer() {
+    // The whole chunk is in memory so it is given to zlib in one go
+    const uInt len = remainingChunk;
+    remainingChunk = 0;
+    return {inBuff, len};
   }
 
   std::pair<Bytef *, uInt> getOutputBuffer() {
     return {outBuff, outBuffSize};
   }
   
-  void processOutputBuffer() {
-    copyFromByteOrder(image.scanLine(rowIdx++), outBuff, outBuffSize, format);
+  Error processOutputBuffer() {
+    if (filter) {
+      TRY(unfilterRow(rowBuff, outBuff, prevBuff, rowSize, byteDepth(format)));
+    }
+    copyFromByteOrder(image.scanLine(rowIdx++), rowBuff, rowSize, format);
+    if (filter) std::swap(rowBuff, prevBuff);
+    return {};
   }
 };
 
 }
 
-Error readCDAT(QIODevice &dev, QImage &image, const Format format) try {
+Error readCDAT(QIODevice &dev, CelData &data, CelBuffer &buffer) try {
   SCOPE_TIME("readCDAT");
-
-  assert(!image.isNull());
   
   ChunkReader reader{dev};
   const ChunkStart start = reader.begin();
   TRY(expectedName(start, chunk_cel_data));
-  DecompressContext context{reader, image, format, start.length};
-  TRY(zlibDecompress(context));
+  data.length = start.length;
+  if (const unsigned char *mapped = reader.mapped()) {
+    buffer.mapped = mapped;
+    data.offset = reader.readInPlace(data.length) - mapped;
+  } else {
+    if (qint64{start.length} > dev.bytesAvailable()) {
+      return chunkLengthInvalid(start);
+    }
+    data.offset = buffer.copied.size();
+    buffer.copied.resize(data.offset + data.length);
+    reader.readString(buffer.copied.data() + data.offset, data.length);
+  }
   return reader.end();
 } catch (FileIOError &e) {
   return e.msg();
 }
 
+Error skipCDAT(QIODevice &dev) try {
+  SCOPE_TIME("skipCDAT");
+  
+  ChunkReader reader{dev};
+  const ChunkStart start = reader.peek();
+  TRY(expectedName(start, chunk_cel_data));
+  reader.skip(start);
+  return {};
+} catch (FileIOError &e) {
+  return e.msg();
+}
+
+Error inflateCDAT(
+  const unsigned char *buffer,
+  const CelData &data,
+  const Format format,
+  const bool filter
+) {
+  SCOPE_TIME("inflateCDAT");
+  
+  assert(data.image && !data.image->isNull());
+  
+  DecompressContext context{buffer + data.offset, *data.image, format, filter, data.length};
+  return zlibDecompress(context);
+}
+
+QByteArray copyCDAT(const unsigned char *buffer, const CelData &data) {
+  SCOPE_TIME("copyCDAT");
+  
+  const std::size_t size = 2 * file_int_size + chunk_name_len + data.length;
+  QByteArray chunk{static_cast<int>(size), Qt::Uninitialized};
+  char *dst = chunk.data();
+  qToLittleEndian(data.length, dst);
+  dst += file_int_size;
+  std::memcpy(dst, chunk_cel_data, chunk_name_len);
+  std::memcpy(dst + chunk_name_len, buffer + data.offset, data.length);
+  const uInt crcLen = static_cast<uInt>(chunk_name_len + data.length);
+  const auto crc = crc32(0, reinterpret_cast<const Bytef *>(dst), crcLen);
+  qToLittleEndian(static_cast<std::uint32_t>(crc), dst + crcLen);
+  return chunk;
+}
+
+CelCompression compressionCDAT(const unsigned char *buffer, const CelData &data, const bool filter) {
+  // The FLEVEL field of the zlib header is a hint of the level and strategy
+  // that the data was compressed with
+  CelCompression compression = {0, CelStrategy::normal, filter};
+  if (data.length < 2) return compression;
+  switch (buffer[data.offset + 1] >> 6) {
+    case 0:
+      compression.level = cel_compression_fast.level;
+      compression.strategy = cel_compression_fast.strategy;
+      break;
+    case 1: compression.level = 5; break;
+    case 2: compression.level = 6; break;
+    case 3: compression.level = 9; break;
+  }
+  return compression;
+}
+
+Error readCREF(QIODevice &dev, std::optional<std::uint32_t> &ref, const std::uint32_t count) try {
+  SCOPE_TIME("readCREF");
+  
+  ref.reset();
+  ChunkReader reader{dev};
+  ChunkStart start = reader.peek();
+  if (std::memcmp(start.name, chunk_cel_reference, chunk_name_len) != 0) return {};
+  start = reader.begin();
+  if (start.length != file_int_size) {
+    return chunkLengthInvalid(start);
+  }
+  
+  const std::uint32_t data = reader.readInt();
+  
+  TRY(reader.end());
+  
+  if (data >= count) return "Cel reference out-of-range";
+  ref = data;
+  return {};
+} catch (FileIOError &e) {
+  return e.msg();
+}
+
+namespace {
+
+std::optional<std::uint32_t> readIndexFooter(QIODevice &dev, const qint64 footerPos) {
+  static_assert(sizeof(std::uint32_t) == file_int_size);
+  std::uint32_t indexPos;
+  if (!dev.seek(footerPos)) return std::nullopt;
+  if (dev.read(reinterpret_cast<char *>(&indexPos), file_int_size) != file_int_size) {
+    return std::nullopt;
+  }
+  return qFromLittleEndian(indexPos);
+}
+
+}
+
+Error readINDX(QIODevice &dev, std::vector<LayerIndex> &index, const AnimationInfo &info) try {
+  SCOPE_TIME("readINDX");
+  
+  // The last Uint of the index is the offset of the index. The index is
+  // followed by its CRC and then the AEND chunk.
+  index.clear();
+  const qint64 footerPos = dev.size() - 4 * file_int_size - chunk_name_len;
+  if (footerPos <= 0) return {};
+  const std::optional<std::uint32_t> indexPos = readIndexFooter(dev, footerPos);
+  if (!indexPos || *indexPos >= footerPos || !dev.seek(*indexPos)) return {};
+  
+  ChunkReader reader{dev};
+  const ChunkStart start = reader.peek();
+  if (std::memcmp(start.name, chunk_index, chunk_name_len) != 0) return {};
+  reader.begin();
+  const qint64 dataPos = *indexPos + file_int_size + chunk_name_len;
+  if (start.length < file_int_size || start.length != footerPos + file_int_size - dataPos) {
+    return chunkLengthInvalid(start);
+  }
+  
+  std::uint32_t remaining = start.length - file_int_size;
+  index.resize(+info.layers);
+  for (LayerIndex &layer : index) {
+    if (remaining < 2 * file_int_size) return chunkLengthInvalid(start);
+    remaining -= 2 * file_int_size;
+    layer.header = reader.readInt();
+    const std::uint32_t cels = reader.readInt();
+    if (cels == 0 || cels > remaining / (3 * file_int_size)) {
+      return chunkLengthInvalid(start);
+    }
+    remaining -= 3 * file_int_size * cels;
+    if (layer.header == 0 || layer.header >= *indexPos) {
+      return "Layer offset out-of-range";
+    }
+    
+    layer.cels.resize(cels);
+    FrameIdx prevFrame{-1};
+    for (CelIndex &cel : layer.cels) {
+      cel.frame = static_cast<FrameIdx>(reader.readInt());
+      cel.header = reader.readInt();
+      cel.data = reader.readInt();
+      if (cel.frame <= prevFrame || info.frames <= cel.frame) {
+        return "Cel frame out-of-range";
+      }
+      if (cel.header <= layer.header || cel.header >= *indexPos) {
+        return "Cel offset out-of-range";
+      }
+      // A cel that references the data of an earlier cel has the offset of
+      // that data
+      if (cel.data != 0 && (cel.data == cel.header || cel.data >= *indexPos)) {
+        return "Cel offset out-of-range";
+      }
+      prevFrame = cel.frame;
+    }
+    if (layer.cels.front().frame != FrameIdx{0}) {
+      return "Cel frame out-of-range";
+    }
+  }
+  
+  if (remaining != 0) return chunkLengthInvalid(start);
+  if (reader.readInt() != *indexPos) {
+    return "Index footer does not match index offset";
+  }
+  TRY(reader.end());
+  
+  return {};
+} catch (FileIOError &e) {
+  index.clear();
+  return e.msg();
+}
+
 Error readAEND(QIODevice &dev) try {
   SCOPE_TIME("readAEND");
 
+  // The index is only useful for random access so it is skipped. Chunks that
+  // were added after this reader are skipped with a warning.
   ChunkReader reader{dev};
+  for (ChunkStart start = reader.peek(); ; start = reader.peek()) {
+    if (std::memcmp(start.name, chunk_anim_end, chunk_name_len) == 0) break;
+    if (std::memcmp(start.name, chunk_index, chunk_name_len) != 0) {
+      std::cerr << "Animation warning: skipping unknown '";
+      std::cerr << std::string_view{start.name, chunk_name_len} << "' chunk\n";
+    }
+    reader.skip(start);
+  }
+  
   const ChunkStart start = reader.begin();
   TRY(expectedName(start, chunk_anim_end));
   if (start.length != 0) {
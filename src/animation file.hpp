@@ -9,6 +9,7 @@
 #ifndef animera_animation_file_hpp
 #define animera_animation_file_hpp
 
+#include <optional>
 #include "cel.hpp"
 #include "error.hpp"
 #include "image.hpp"
@@ -27,6 +28,42 @@ struct AnimationInfo {
   FrameIdx frames;
   int delay;
   Format format;
+  /// Whether the scanlines of the cel data are filtered
+  bool filter;
+};
+
+/// The file offsets of the chunks for a cel. The data offset is 0 if the cel
+/// is null. Cels that share their data with an earlier cel have the offset of
+/// the earlier CDAT chunk.
+struct CelIndex {
+  FrameIdx frame;
+  qint64 header;
+  qint64 data;
+};
+
+/// The file offsets of the chunks for a layer and its cels
+struct LayerIndex {
+  qint64 header;
+  std::vector<CelIndex> cels;
+};
+
+/// A CDAT chunk that has been read and checked but not yet decompressed. The
+/// compressed data is at the offset within the CelBuffer passed to readCDAT.
+struct CelData {
+  QImage *image;
+  std::size_t offset;
+  std::uint32_t length;
+};
+
+/// The compressed data read by readCDAT. The data is copied into a buffer
+/// unless the file is in memory in which case it is read in-place.
+struct CelBuffer {
+  std::vector<unsigned char> copied;
+  const unsigned char *mapped = nullptr;
+  
+  const unsigned char *data() const {
+    return mapped ? mapped : copied.data();
+  }
 };
 
 Error writeSignature(QIODevice &);
@@ -35,7 +72,13 @@ Error writePLTE(QIODevice &, PaletteCSpan, Format);
 Error writeGRPS(QIODevice &, const std::vector<Group> &);
 Error writeLHDR(QIODevice &, const Layer &);
 Error writeCHDR(QIODevice &, const Cel &);
-Error writeCDAT(QIODevice &, const QImage &, Format);
+/// The length of the compressed data isn't known until it has been written so
+/// the device must be able to seek. Compress into a QBuffer when writing to a
+/// FileWriter.
+Error writeCDAT(QIODevice &, const QImage &, Format, const CelCompression &);
+Error writeCDAT(QIODevice &, const QByteArray &);
+Error writeCREF(QIODevice &, std::uint32_t);
+Error writeINDX(QIODevice &, const std::vector<LayerIndex> &);
 Error writeAEND(QIODevice &);
 
 Error readSignature(QIODevice &);
@@ -44,7 +87,20 @@ Error readPLTE(QIODevice &, PaletteSpan, Format);
 Error readGRPS(QIODevice &, std::vector<Group> &, FrameIdx);
 Error readLHDR(QIODevice &, Layer &);
 Error readCHDR(QIODevice &, Cel &, Format);
-Error readCDAT(QIODevice &, QImage &, Format);
+Error readCDAT(QIODevice &, CelData &, CelBuffer &);
+Error skipCDAT(QIODevice &);
+Error inflateCDAT(const unsigned char *, const CelData &, Format, bool);
+/// Rebuild a CDAT chunk that was read by readCDAT so that it can be written
+/// again without compressing the image
+QByteArray copyCDAT(const unsigned char *, const CelData &);
+/// Determine the compression options of a CDAT chunk that was read by
+/// readCDAT. The level is inferred from the zlib header.
+CelCompression compressionCDAT(const unsigned char *, const CelData &, bool);
+/// Reads a CREF chunk if the next chunk is a CREF chunk. The reference is the
+/// number of CDAT chunks before the referenced CDAT chunk and it must be less
+/// than the number of CDAT chunks read so far.
+Error readCREF(QIODevice &, std::optional<std::uint32_t> &, std::uint32_t);
+Error readINDX(QIODevice &, std::vector<LayerIndex> &, const AnimationInfo &);
 Error readAEND(QIODevice &);
 
 #endif
@@ -36,30 +36,38 @@ void Animation::newFile(const Format newFormat, const QSize newSize) {
 }
 
 Error Animation::saveFile(const QString &path) const {
+  return saveFile(path, cel_compression_normal);
+}
+
+Error Animation::saveFile(const QString &path, const CelCompression &compression) const {
   SCOPE_TIME("Animation::saveFile");
 
   FileWriter writer;
   TRY(writer.open(path));
   TRY(writeSignature(writer.dev()));
-  TRY(timeline.serializeHead(writer.dev()));
+  TRY(timeline.serializeHead(writer.dev(), compression));
   TRY(palette.serialize(writer.dev()));
-  TRY(timeline.serializeBody(writer.dev()));
+  TRY(timeline.serializeBody(writer.dev(), compression));
   TRY(timeline.serializeTail(writer.dev()));
   return writer.flush();
 }
 
 Error Animation::openFile(const QString &path) {
+  return openFile(path, {LayerIdx{0}, FrameIdx{0}, LayerIdx{-1}, FrameIdx{-1}});
+}
+
+Error Animation::openFile(const QString &path, const CelRect rect) {
   SCOPE_TIME("Animation::openFile");
   
   FileReader reader;
-  TRY(reader.open(path));
+  TRY(reader.openMapped(path));
   TRY(readSignature(reader.dev()));
   TRY(timeline.deserializeHead(reader.dev(), format, size));
   Q_EMIT canvasInitialized(format, size);
   palette.initCanvas(format);
   timeline.initCanvas(format, size);
   TRY(palette.deserialize(reader.dev()));
-  TRY(timeline.deserializeBody(reader.dev()));
+  TRY(timeline.deserializeBody(reader.dev(), rect));
   TRY(timeline.deserializeTail(reader.dev()));
   return reader.flush();
 }
@@ -77,6 +85,15 @@ Error Animation::openImage(const QString &path) {
   return {};
 }
 
+void Animation::snapshot(Animation &copy) const {
+  SCOPE_TIME("Animation::snapshot");
+  
+  copy.format = format;
+  copy.size = size;
+  timeline.snapshot(copy.timeline);
+  palette.snapshot(copy.palette);
+}
+
 Format Animation::getFormat() const {
   return format;
 }
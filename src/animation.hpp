@@ -37,6 +37,13 @@ public:
   
   Format getFormat() const;
   QSize getSize() const;
+  
+  Error saveFile(const QString &, const CelCompression &) const;
+  // Only the cels within the rectangle are decoded
+  Error openFile(const QString &, CelRect);
+  /// Copy the parts of the animation that are saved without emitting any
+  /// signals. The copy can be saved on another thread.
+  void snapshot(Animation &) const;
 
 private:
   Format format;
@@ -10,10 +10,13 @@
 
 #include "window.hpp"
 #include "connect.hpp"
+#include "autosave.hpp"
 #include "settings.hpp"
 #include <QtGui/qevent.h>
 #include "global font.hpp"
 #include "config colors.hpp"
+#include "recover dialog.hpp"
+#include <QtCore/qfileinfo.h>
 #include <QtWidgets/qtooltip.h>
 #include "init canvas dialog.hpp"
 #include <QtWidgets/qfiledialog.h>
@@ -51,6 +54,31 @@ void Application::openFileDialog() {
   dialog->exec();
 }
 
+void Application::recoverUntitled() {
+  const QStringList paths = untitledRecoveryPaths();
+  if (paths.empty()) return;
+  
+  // The new file dialog is only shown if every recovery file is discarded
+  const bool waiting = noFileTimer.isActive();
+  noFileTimer.stop();
+  pendingRecovery = paths.size();
+  for (const QString &path : paths) {
+    auto *dialog = new RecoverDialog{desktop(), "an untitled animation"};
+    CONNECT_LAMBDA(dialog, accepted, [this, path]() {
+      makeWindow()->recoverUntitled(path);
+    });
+    CONNECT_LAMBDA(dialog, rejected, [path]() {
+      QFile::remove(path);
+    });
+    CONNECT_LAMBDA(dialog, finished, [this, waiting]() {
+      if (--pendingRecovery == 0 && waiting && windows.empty()) {
+        newFileDialog();
+      }
+    });
+    dialog->open();
+  }
+}
+
 void Application::windowClosed(Window *window) {
   windows.erase(std::remove(windows.begin(), windows.end(), window), windows.end());
 }
@@ -83,6 +111,26 @@ void Application::openFile(const QString &path) {
       return raiseWindow(window);
     }
   }
+  
+  // A recovery file is left behind if the application didn't close normally.
+  // It is ignored if the animation was saved after it was written.
+  const QFileInfo recovery{recoveryPath(path)};
+  if (recovery.exists()) {
+    if (recovery.lastModified() < QFileInfo{path}.lastModified()) {
+      QFile::remove(recovery.filePath());
+    } else {
+      auto *dialog = new RecoverDialog{desktop(), QFileInfo{path}.fileName()};
+      CONNECT_LAMBDA(dialog, accepted, [this, path]() {
+        makeWindow()->recoverFile(path);
+      });
+      CONNECT_LAMBDA(dialog, rejected, [this, path]() {
+        QFile::remove(recoveryPath(path));
+        makeWindow()->openFile(path);
+      });
+      return dialog->open();
+    }
+  }
+  
   makeWindow()->openFile(path);
 }
 
@@ -24,6 +24,9 @@ public:
   void waitForOpenEvent();
   void newFileDialog();
   void openFileDialog();
+  /// Offer to recover the animations that were never saved if the application
+  /// didn't close normally
+  void recoverUntitled();
   void windowClosed(Window *);
   bool isClosing() const;
 
@@ -34,6 +37,7 @@ public Q_SLOTS:
 private:
   std::vector<Window *> windows;
   QTimer noFileTimer;
+  int pendingRecovery = 0;
   bool closing = false;
 
   void initStyles();
@@ -9,6 +9,7 @@
 #ifndef animera_atlas_generator_hpp
 #define animera_atlas_generator_hpp
 
+#include <vector>
 #include "error.hpp"
 #include "sprite name.hpp"
 #include "palette span.hpp"
@@ -17,6 +18,7 @@ struct AtlasInfo {
   QString name;
   QString directory;
   PixelFormat pixelFormat;
+  bool trim;
 };
 
 struct NameInfo {
@@ -55,6 +57,9 @@ public:
   
   /// Complete the atlas
   virtual Error endAtlas() = 0;
+  
+  /// Get the paths of the files that were written for the atlas
+  virtual std::vector<QString> outputs() const = 0;
 };
 
 #endif
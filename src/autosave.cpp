@@ -0,0 +1,171 @@
+﻿//
+//  autosave.cpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#include "autosave.hpp"
+
+#include "connect.hpp"
+#include "animation.hpp"
+#include "scope time.hpp"
+#include <QtCore/qdir.h>
+#include <QtCore/quuid.h>
+#include <QtCore/qthread.h>
+#include <QtCore/qfileinfo.h>
+#include <QtCore/qrunnable.h>
+#include "config geometry.hpp"
+#include <QtCore/qstandardpaths.h>
+#include <QtCore/qcryptographichash.h>
+
+namespace {
+
+QString recoveryDir() {
+  return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/Recovery";
+}
+
+QString untitledRecoveryPath() {
+  const QString name = QUuid::createUuid().toString(QUuid::WithoutBraces);
+  return recoveryDir() + "/Untitled/" + name + ".animera";
+}
+
+}
+
+QString recoveryPath(const QString &path) {
+  const QByteArray absolute = QFileInfo{path}.absoluteFilePath().toUtf8();
+  const QByteArray hash = QCryptographicHash::hash(absolute, QCryptographicHash::Sha1).toHex();
+  return recoveryDir() + "/" + QString::fromLatin1(hash) + ".animera";
+}
+
+QStringList untitledRecoveryPaths() {
+  const QDir dir{recoveryDir() + "/Untitled"};
+  QStringList paths;
+  for (const QFileInfo &info : dir.entryInfoList({"*.animera"}, QDir::Files)) {
+    paths.push_back(info.absoluteFilePath());
+  }
+  return paths;
+}
+
+namespace {
+
+// The snapshot is created on the GUI thread and destroyed on the worker. It
+// is released from the GUI thread so that the worker can take ownership of it.
+void moveSnapshot(Animation &snapshot, QThread *thread) {
+  snapshot.moveToThread(thread);
+  snapshot.timeline.moveToThread(thread);
+  snapshot.palette.moveToThread(thread);
+}
+
+class AutosaveWorker final : public QRunnable {
+public:
+  AutosaveWorker(
+    std::unique_ptr<Animation> snapshot,
+    QString path,
+    std::atomic<bool> &busy,
+    std::atomic<int> &generation,
+    QObject &context,
+    std::function<void(const QString &)> errorHandler
+  ) : snapshot{std::move(snapshot)},
+      path{std::move(path)},
+      busy{busy},
+      generation{generation},
+      startGeneration{generation.load()},
+      context{context},
+      errorHandler{std::move(errorHandler)} {}
+  
+  void run() override {
+    SCOPE_TIME("AutosaveWorker::run");
+    
+    moveSnapshot(*snapshot, QThread::currentThread());
+    
+    // The file is replaced atomically so a failed autosave leaves the previous
+    // recovery file intact. The error is reported and the next autosave will
+    // try again.
+    QDir{}.mkpath(QFileInfo{path}.absolutePath());
+    if (Error err = snapshot->saveFile(path, cel_compression_fast); err) {
+      reportError(err.msg());
+    }
+    
+    // If the recovery file was discarded while the snapshot was being
+    // written then the snapshot is out of date
+    if (generation.load() != startGeneration) {
+      QFile::remove(path);
+    }
+    busy.store(false);
+  }
+
+private:
+  std::unique_ptr<Animation> snapshot;
+  QString path;
+  std::atomic<bool> &busy;
+  std::atomic<int> &generation;
+  int startGeneration;
+  QObject &context;
+  std::function<void(const QString &)> errorHandler;
+  
+  void reportError(const QString &msg) {
+    if (!errorHandler) return;
+    QMetaObject::invokeMethod(&context, [handler = errorHandler, msg]() {
+      handler(msg);
+    }, Qt::QueuedConnection);
+  }
+};
+
+}
+
+Autosave::Autosave(const Animation &anim)
+  : anim{anim}, recovery{untitledRecoveryPath()} {
+  pool.setMaxThreadCount(1);
+  timer.setSingleShot(true);
+  CONNECT_LAMBDA(timer, timeout, [this]() {
+    save();
+  });
+}
+
+Autosave::~Autosave() {
+  pool.waitForDone();
+}
+
+void Autosave::setPath(const QString &path) {
+  recovery = recoveryPath(path);
+}
+
+void Autosave::setRecoveryPath(const QString &path) {
+  recovery = path;
+}
+
+void Autosave::modify() {
+  if (!timer.isActive()) timer.start(auto_interval);
+}
+
+void Autosave::discard() {
+  timer.stop();
+  ++generation;
+  QFile::remove(recovery);
+}
+
+void Autosave::onError(std::function<void(const QString &)> handler) {
+  errorHandler = std::move(handler);
+}
+
+void Autosave::save() {
+  // The snapshot is taken between strokes because the image of the current
+  // cel is modified in place during a stroke. If the previous autosave hasn't
+  // finished yet then it is tried again later.
+  if (busy.load() || anim.timeline.isLocked()) {
+    timer.start(auto_retry_interval);
+    return;
+  }
+  
+  SCOPE_TIME("Autosave::save");
+  
+  auto snapshot = std::make_unique<Animation>();
+  anim.snapshot(*snapshot);
+  moveSnapshot(*snapshot, nullptr);
+  busy.store(true);
+  pool.start(new AutosaveWorker{
+    std::move(snapshot), recovery, busy, generation, timer, errorHandler
+  });
+}
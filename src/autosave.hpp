@@ -0,0 +1,59 @@
+﻿//
+//  autosave.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_autosave_hpp
+#define animera_autosave_hpp
+
+#include <atomic>
+#include <functional>
+#include <QtCore/qtimer.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qthreadpool.h>
+
+class Animation;
+
+/// Get the path of the recovery file for an animation file
+QString recoveryPath(const QString &);
+/// Get the paths of the recovery files of animations that were never saved
+QStringList untitledRecoveryPaths();
+
+/// Periodically writes a snapshot of an animation to its recovery file. The
+/// snapshot shares cel images with the animation so taking it is cheap. The
+/// snapshot is written on a worker thread so the editor never waits for it.
+class Autosave {
+public:
+  explicit Autosave(const Animation &);
+  ~Autosave();
+  
+  /// Set the path of the animation file. An animation that has not been saved
+  /// yet has a recovery file of its own with a unique name.
+  void setPath(const QString &);
+  /// Keep writing to the recovery file of an untitled animation that was
+  /// recovered
+  void setRecoveryPath(const QString &);
+  /// Schedule an autosave if one isn't already scheduled
+  void modify();
+  /// Remove the recovery file after the animation is saved or closed
+  void discard();
+  /// Set the function that is called on the GUI thread when an autosave fails
+  void onError(std::function<void(const QString &)>);
+
+private:
+  const Animation &anim;
+  QString recovery;
+  QTimer timer;
+  std::function<void(const QString &)> errorHandler;
+  std::atomic<bool> busy = false;
+  std::atomic<int> generation = 0;
+  // The pool is destroyed first so that it can wait for the worker
+  QThreadPool pool;
+  
+  void save();
+};
+
+#endif
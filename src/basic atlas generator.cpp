@@ -27,7 +27,11 @@ bool BasicAtlasGenerator::supported(const PixelFormat pixelFormat, const Format
 }
 
 Error BasicAtlasGenerator::beginAtlas(const AtlasInfo &info) {
-  packer.init(info.pixelFormat);
+  if (info.trim && info.pixelFormat != PixelFormat::rgba && info.pixelFormat != PixelFormat::gray_alpha) {
+    return "Trimming requires a pixel format with an alpha channel";
+  }
+  packer.init(info.pixelFormat, info.trim);
+  trim = info.trim;
   names.clear();
   names.insert("null_");
   collision.clear();
@@ -81,14 +85,11 @@ void BasicAtlasGenerator::appendName(const std::size_t i, const NameInfo info) {
       }
     }
   }
-  
-  packer.append(info.size);
 }
 
 void BasicAtlasGenerator::appendWhiteName(const std::size_t i) {
   appendName("whitepixel_", i);
   insertName("whitepixel_");
-  packer.appendWhite();
 }
 
 QString BasicAtlasGenerator::endNames() {
@@ -96,24 +97,37 @@ QString BasicAtlasGenerator::endNames() {
 }
 
 Error BasicAtlasGenerator::beginImages() {
-  return packer.pack();
+  return {};
 }
 
 Error BasicAtlasGenerator::setImageFormat(const Format format, const PaletteCSpan palette) {
   return packer.setFormat(format, palette);
 }
 
-Error BasicAtlasGenerator::copyImage(const std::size_t i, const QImage &img) {
-  if (img.isNull()) {
-    appendRect({});
-  } else {
-    appendRect(packer.copy(i, img));
-  }
+Error BasicAtlasGenerator::copyImage([[maybe_unused]] const std::size_t i, const QImage &img) {
+  assert(i == packer.count());
+  packer.append(img);
+  return {};
+}
+
+Error BasicAtlasGenerator::copyWhiteImage([[maybe_unused]] const std::size_t i) {
+  assert(i == packer.count());
+  packer.appendWhite();
   return {};
 }
 
-Error BasicAtlasGenerator::copyWhiteImage(const std::size_t i) {
-  appendRect(packer.copyWhite(i));
+Error BasicAtlasGenerator::endImages() {
+  // Packing is deferred until all of the images are known so that duplicates
+  // can be packed once
+  TRY(packer.pack());
+  for (std::size_t i = 0; i != packer.count(); ++i) {
+    appendRect(packer.rect(i));
+  }
+  if (trim) {
+    for (std::size_t i = 0; i != packer.count(); ++i) {
+      appendTrim(packer.offset(i), packer.untrimmedSize(i));
+    }
+  }
   return {};
 }
 
@@ -33,13 +33,16 @@ public:
 
   virtual void appendName(const QString &, std::size_t) = 0;
   virtual void appendRect(QRect) = 0;
+  virtual void appendTrim(QPoint, QSize) = 0;
   virtual void fixName(QString &, std::array<int, 4> &) = 0;
   virtual void appendAlias(QString, const char *, std::size_t) = 0;
 
 protected:
   SpritePacker packer;
+  bool trim = false;
 
   void insertName(const QString &);
+  Error endImages();
 
 private:
   std::unordered_set<QString> names;
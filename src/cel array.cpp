@@ -8,6 +8,8 @@
 
 #include "cel array.hpp"
 
+#include <algorithm>
+
 namespace {
 
 FrameIdx arrayLength(const std::vector<Cel> &cels) {
@@ -28,13 +30,14 @@ void shrinkCel(std::vector<Cel> &cels, std::vector<Cel>::iterator cel) {
 template <typename Cels>
 auto findCelIter(Cels &cels, FrameIdx &idx) {
   assert(FrameIdx{0} <= idx);
-  for (auto s = cels.begin(); s != cels.end(); ++s) {
-    if (idx < s->len) {
-      return s;
-    }
-    idx -= s->len;
-  }
-  Q_UNREACHABLE();
+  auto iter = std::upper_bound(cels.begin(), cels.end(), idx, [](const FrameIdx idx, const Cel &cel) {
+    return idx < cel.start;
+  });
+  assert(iter != cels.begin());
+  --iter;
+  idx -= iter->start;
+  assert(idx < iter->len);
+  return iter;
 }
 
 }
@@ -58,6 +61,14 @@ bool CelIterator::incr() {
   }
 }
 
+void indexCelArray(std::vector<Cel> &cels) {
+  FrameIdx start{0};
+  for (Cel &cel : cels) {
+    cel.start = start;
+    start += cel.len;
+  }
+}
+
 void optimizeCelArray(std::vector<Cel> &cels) {
   FrameIdx prevNull{0};
   for (auto s = cels.begin(); s != cels.end(); ++s) {
@@ -72,6 +83,7 @@ void optimizeCelArray(std::vector<Cel> &cels) {
       prevNull = FrameIdx{0};
     }
   }
+  indexCelArray(cels);
 }
 
 CelImage *getImage(std::vector<Cel> &cels, const FrameIdx idx) {
@@ -82,6 +94,33 @@ const CelImage *getImage(const tcb::span<const Cel> cels, FrameIdx idx) {
   return findCelIter(cels, idx)->cel.get();
 }
 
+const CelImage *getImage(const tcb::span<const Cel> cels, CelCursor &cursor, const FrameIdx idx) {
+  assert(FrameIdx{0} <= idx);
+  // Walking forward from the start is quicker if the index is closer to it
+  if (cursor.cel >= cels.size() || idx < cursor.start - idx) {
+    cursor = {};
+  }
+  while (idx < cursor.start) {
+    --cursor.cel;
+    cursor.start -= cels[cursor.cel].len;
+  }
+  while (cursor.start + cels[cursor.cel].len <= idx) {
+    cursor.start += cels[cursor.cel].len;
+    ++cursor.cel;
+    assert(cursor.cel < cels.size());
+  }
+  return cels[cursor.cel].cel.get();
+}
+
+FrameIdx celBegin(const tcb::span<const Cel> cels, FrameIdx idx) {
+  return findCelIter(cels, idx)->start;
+}
+
+FrameIdx celEnd(const tcb::span<const Cel> cels, FrameIdx idx) {
+  const auto iter = findCelIter(cels, idx);
+  return iter->start + iter->len;
+}
+
 void insertCelFrame(std::vector<Cel> &cels, FrameIdx idx) {
   auto iter = findCelIter(cels, idx);
   if (iter->cel->isNull()) {
@@ -96,6 +135,7 @@ void insertCelFrame(std::vector<Cel> &cels, FrameIdx idx) {
   } else {
     cels.insert(++iter, {std::make_unique<CelImage>(), FrameIdx{1}});
   }
+  indexCelArray(cels);
 }
 
 void replaceCelFrame(std::vector<Cel> &cels, FrameIdx idx, const bool isolate) {
@@ -110,16 +150,16 @@ void replaceCelFrame(std::vector<Cel> &cels, FrameIdx idx, const bool isolate) {
   if (leftSize == FrameIdx{0}) {
     iter->len = rightSize;
     cels.insert(iter, {std::make_unique<CelImage>(), FrameIdx{1}});
-    return;
   } else if (rightSize == FrameIdx{0}) {
     iter->len = leftSize;
     cels.insert(++iter, {std::make_unique<CelImage>(), FrameIdx{1}});
-    return;
+  } else {
+    iter->len = leftSize;
+    CelImagePtr copy = std::make_unique<CelImage>(*iter->cel);
+    iter = cels.insert(++iter, {std::make_unique<CelImage>(), FrameIdx{1}});
+    cels.insert(++iter, {std::move(copy), rightSize});
   }
-  iter->len = leftSize;
-  CelImagePtr copy = std::make_unique<CelImage>(*iter->cel);
-  iter = cels.insert(++iter, {std::make_unique<CelImage>(), FrameIdx{1}});
-  cels.insert(++iter, {std::move(copy), rightSize});
+  indexCelArray(cels);
 }
 
 void extendCel(std::vector<Cel> &cels, FrameIdx idx) {
@@ -127,7 +167,8 @@ void extendCel(std::vector<Cel> &cels, FrameIdx idx) {
   const auto next = std::next(iter);
   if (next == cels.end()) return;
   ++iter->len;
-  return shrinkCel(cels, next);
+  shrinkCel(cels, next);
+  indexCelArray(cels);
 }
 
 void splitCel(std::vector<Cel> &cels, FrameIdx idx) {
@@ -138,6 +179,7 @@ void splitCel(std::vector<Cel> &cels, FrameIdx idx) {
   iter->len = leftSize;
   CelImagePtr copy = std::make_unique<CelImage>(*iter->cel);
   cels.insert(++iter, {std::move(copy), rightSize});
+  indexCelArray(cels);
 }
 
 namespace {
@@ -197,6 +239,28 @@ void replaceCelArray(std::vector<Cel> &cels, FrameIdx idx, std::vector<Cel> &new
       cels.erase(prevEnd);
     }
   }
+  indexCelArray(cels);
+}
+
+void swapCelRange(std::vector<Cel> &cels, const FrameIdx idx, FrameIdx &len, std::vector<Cel> &other) {
+  const FrameIdx length = arrayLength(cels);
+  if (idx < length) splitCel(cels, idx);
+  if (idx + len < length) splitCel(cels, idx + len);
+  
+  const auto startsBefore = [](const Cel &cel, const FrameIdx idx) {
+    return cel.start < idx;
+  };
+  const auto first = std::lower_bound(cels.begin(), cels.end(), idx, startsBefore);
+  const auto last = std::lower_bound(first, cels.end(), idx + len, startsBefore);
+  std::vector<Cel> removed{
+    std::make_move_iterator(first),
+    std::make_move_iterator(last)
+  };
+  const auto pos = cels.erase(first, last);
+  len = arrayLength(other);
+  insertCels(cels, pos, other);
+  other = std::move(removed);
+  indexCelArray(cels);
 }
 
 std::vector<Cel> extractCelArray(tcb::span<const Cel> cels, FrameIdx idx, FrameIdx len) {
@@ -220,6 +284,7 @@ std::vector<Cel> extractCelArray(tcb::span<const Cel> cels, FrameIdx idx, FrameI
       newCels.push_back({std::make_unique<CelImage>(*cel->cel), len});
     }
   }
+  indexCelArray(newCels);
   return newCels;
 }
 
@@ -238,11 +303,13 @@ std::vector<Cel> truncateCopyCelArray(tcb::span<const Cel> cels, FrameIdx len) {
       newCels.push_back({std::make_unique<CelImage>(), len});
     }
   }
+  indexCelArray(newCels);
   return newCels;
 }
 
 void removeCelFrame(std::vector<Cel> &cels, FrameIdx idx) {
   shrinkCel(cels, findCelIter(cels, idx));
+  indexCelArray(cels);
 }
 
 void clearCelArray(std::vector<Cel> &cels, const FrameIdx len) {
@@ -15,6 +15,9 @@
 struct Cel {
   CelImagePtr cel;
   FrameIdx len;
+  /// The first frame of the cel. This is kept up to date by the functions below
+  /// so that finding the cel of a frame is a binary search
+  FrameIdx start{0};
 };
 
 struct Layer {
@@ -35,6 +38,16 @@ private:
   FrameIdx idx;
 };
 
+/// A position within a cel array that is remembered between lookups. The
+/// cursor must be reset when the cel array is modified
+struct CelCursor {
+  std::size_t cel = 0;
+  FrameIdx start{0};
+};
+
+/// Update the start frame of each cel after modifying the array directly
+void indexCelArray(std::vector<Cel> &);
+
 /// Combine consecutive null cels into a single cel
 void optimizeCelArray(std::vector<Cel> &);
 
@@ -44,6 +57,16 @@ CelImage *getImage(std::vector<Cel> &, FrameIdx);
 /// Get a constant image
 const CelImage *getImage(tcb::span<const Cel>, FrameIdx);
 
+/// Get a constant image by moving the cursor from its previous position.
+/// Stepping to an adjacent frame takes constant time
+const CelImage *getImage(tcb::span<const Cel>, CelCursor &, FrameIdx);
+
+/// Get the first frame of the cel at the index
+FrameIdx celBegin(tcb::span<const Cel>, FrameIdx);
+
+/// Get the frame after the last frame of the cel at the index
+FrameIdx celEnd(tcb::span<const Cel>, FrameIdx);
+
 /// Insert a new cel after the index
 void insertCelFrame(std::vector<Cel> &, FrameIdx);
 
@@ -61,6 +84,11 @@ void splitCel(std::vector<Cel> &, FrameIdx);
 /// Replace part of an array with another array
 void replaceCelArray(std::vector<Cel> &, FrameIdx, std::vector<Cel> &);
 
+/// Swap a range of frames with another cel array. Cels are split at the ends
+/// of the range if necessary. The length of the range is updated to the length
+/// of the other array and the other array receives the cels that were removed
+void swapCelRange(std::vector<Cel> &, FrameIdx, FrameIdx &, std::vector<Cel> &);
+
 /// Make a copy of part of the cel array
 std::vector<Cel> extractCelArray(tcb::span<const Cel>, FrameIdx, FrameIdx);
 
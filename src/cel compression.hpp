@@ -0,0 +1,46 @@
+﻿//
+//  cel compression.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_cel_compression_hpp
+#define animera_cel_compression_hpp
+
+#include <cstdint>
+
+enum class CelStrategy : std::uint8_t {
+  normal,
+  rle
+};
+
+/// Options for compressing the cel data of an animation file. These affect the
+/// time it takes to save and load and the size of the file but not its
+/// contents.
+struct CelCompression {
+  /// The zlib compression level [0, 9]
+  int level;
+  CelStrategy strategy;
+  /// Whether each scanline is filtered the same way as PNG before compressing
+  bool filter;
+  
+  bool operator==(const CelCompression &) const = default;
+};
+
+/// Compatible with files written before the compression options were added
+constexpr CelCompression cel_compression_normal = {6, CelStrategy::normal, false};
+/// Fast enough for saving in the background
+constexpr CelCompression cel_compression_fast = {1, CelStrategy::rle, false};
+/// Slow to save but produces the smallest files
+constexpr CelCompression cel_compression_archive = {9, CelStrategy::normal, true};
+
+/// Determine whether data compressed with the first options can be written
+/// when the second options are requested. The filter applies to the whole file
+/// so it must match. Data that was compressed at least as hard is good enough.
+constexpr bool reusableCompression(const CelCompression &data, const CelCompression &requested) {
+  return data.filter == requested.filter && data.level >= requested.level;
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include <memory>
 #include <vector>
 #include "image.hpp"
+#include "cel compression.hpp"
 #include "enum operators.hpp"
 
 class CelImage;
@@ -25,6 +26,18 @@ public:
   QImage img;
   QPoint pos;
   
+  /// The CDAT chunk that was last read or written for img along with the
+  /// cache key of img and the compression options of the chunk. QImage changes
+  /// its cache key whenever it might be modified so the chunk can be reused
+  /// when saving if the key hasn't changed and the options are compatible.
+  mutable QByteArray chunk;
+  mutable qint64 chunkKey = 0;
+  mutable CelCompression chunkCompression = cel_compression_normal;
+  /// The hash of img that is used to find identical cels when saving along
+  /// with the cache key of img when it was hashed
+  mutable uint hash = 0;
+  mutable qint64 hashKey = 0;
+  
   explicit operator bool() const {
     return !img.isNull();
   }
@@ -10,14 +10,13 @@
 
 #include "zlib.hpp"
 #include <QtCore/qendian.h>
-#include <QtCore/qiodevice.h>
+#include <QtCore/qbuffer.h>
 
 ChunkWriter::ChunkWriter(QIODevice &dev)
   : dev{dev} {}
 
 void ChunkWriter::begin(const std::uint32_t len, const char *name) {
   startPos = dev.pos();
-  assert(startPos != 0);
   length = len;
   writeStart(len, name);
 }
@@ -25,7 +24,6 @@ void ChunkWriter::begin(const std::uint32_t len, const char *name) {
 void ChunkWriter::begin(const char *name) {
   assert(!dev.isSequential());
   startPos = dev.pos();
-  assert(startPos != 0);
   length = std::nullopt;
   writeStart(0, name);
 }
@@ -33,7 +31,6 @@ void ChunkWriter::begin(const char *name) {
 void ChunkWriter::end() {
   const std::uint32_t finalCrc = static_cast<std::uint32_t>(crc);
   const qint64 currPos = dev.pos();
-  assert(currPos != 0);
   const qint64 dataLen = currPos - startPos - chunk_name_len - file_int_size;
   assert(dataLen == qint64{static_cast<std::uint32_t>(dataLen)});
   if (length) {
@@ -83,24 +80,33 @@ void ChunkWriter::writeData(const T *dat, const std::uint32_t len) {
 }
 
 ChunkReader::ChunkReader(QIODevice &dev)
-  : dev{dev} {}
+  : dev{dev} {
+  const auto *buffer = qobject_cast<const QBuffer *>(&dev);
+  if (buffer && buffer->isReadable() && !buffer->isWritable()) {
+    mem = reinterpret_cast<const unsigned char *>(buffer->data().constData());
+    memSize = buffer->data().size();
+  }
+}
 
 ChunkStart ChunkReader::begin() {
+  loadPos();
   ChunkStart start;
   start.length = readInt();
   length = start.length;
   crc = crc32(0, nullptr, 0);
   readString(start.name, chunk_name_len);
   std::memcpy(name, start.name, chunk_name_len);
-  startPos = dev.pos();
+  startPos = pos();
   assert(startPos != 0);
   return start;
 }
 
 Error ChunkReader::end() {
-  assert(dev.pos() - startPos == length);
+  assert(pos() - startPos == length);
   const std::uint32_t finalCrc = static_cast<std::uint32_t>(crc);
-  if (finalCrc != readInt()) {
+  const std::uint32_t fileCrc = readInt();
+  storePos();
+  if (finalCrc != fileCrc) {
     QString msg = "CRC mismatch in '";
     msg += QLatin1String{name, chunk_name_len};
     msg += "' chunk";
@@ -111,10 +117,15 @@ Error ChunkReader::end() {
 }
 
 ChunkStart ChunkReader::peek() {
+  loadPos();
   ChunkStart start;
   start.length = readInt();
   readString(start.name, chunk_name_len);
-  if (!dev.seek(dev.pos() - chunk_name_len - file_int_size)) throw FileIOError{dev};
+  if (mem) {
+    memPos -= chunk_name_len + file_int_size;
+  } else {
+    if (!dev.seek(dev.pos() - chunk_name_len - file_int_size)) throw FileIOError{dev};
+  }
   return start;
 }
 
@@ -148,8 +159,40 @@ void ChunkReader::readString(unsigned char *dat, const std::uint32_t len) {
   readData(dat, len);
 }
 
+const unsigned char *ChunkReader::mapped() const {
+  return mem;
+}
+
+const unsigned char *ChunkReader::readInPlace(const std::uint32_t len) {
+  assert(mem);
+  if (memSize - memPos < len) throw FileIOError{"Unexpected end of file"};
+  const unsigned char *dat = mem + memPos;
+  memPos += len;
+  crc = crc32(crc, dat, len);
+  return dat;
+}
+
+qint64 ChunkReader::pos() const {
+  return mem ? memPos : dev.pos();
+}
+
+// When reading from memory, the position of the device is only updated at
+// the end of a chunk
+
+void ChunkReader::loadPos() {
+  if (mem) memPos = dev.pos();
+}
+
+void ChunkReader::storePos() {
+  if (mem && !dev.seek(memPos)) throw FileIOError{dev};
+}
+
 template <typename T>
 void ChunkReader::readData(T *dat, const std::uint32_t len) {
+  if (mem) {
+    std::memcpy(dat, readInPlace(len), len);
+    return;
+  }
   if (dev.read(reinterpret_cast<char *>(dat), len) != len) {
     throw FileIOError{dev};
   }
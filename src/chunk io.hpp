@@ -47,6 +47,8 @@ struct ChunkStart {
   char name[chunk_name_len];
 };
 
+/// Reads chunks from a device. If the device is a read-only QBuffer (such as a
+/// memory mapped file), the chunks are read directly from memory.
 class ChunkReader {
 public:
   explicit ChunkReader(QIODevice &);
@@ -62,14 +64,27 @@ public:
   void readString(char *, std::uint32_t);
   void readString(signed char *, std::uint32_t);
   void readString(unsigned char *, std::uint32_t);
+  
+  /// The start of the device if it is in memory and null otherwise
+  const unsigned char *mapped() const;
+  /// Returns a pointer to the string without copying it. Only valid if the
+  /// device is in memory.
+  const unsigned char *readInPlace(std::uint32_t);
 
 private:
   QIODevice &dev;
+  const unsigned char *mem = nullptr;
+  qint64 memSize = 0;
+  qint64 memPos = 0;
   unsigned long crc;
   qint64 startPos;
   std::uint32_t length;
   char name[chunk_name_len];
   
+  qint64 pos() const;
+  void loadPos();
+  void storePos();
+  
   template <typename T>
   void readData(T *, std::uint32_t);
 };
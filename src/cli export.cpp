@@ -8,12 +8,19 @@
 
 #include "cli export.hpp"
 
+#include <map>
+#include <optional>
 #include <iostream>
+#include "parallel.hpp"
+#include "animation.hpp"
 #include <QtCore/qdir.h>
+#include "export cache.hpp"
+#include <QtCore/qfileinfo.h>
 #include <QtCore/qjsonarray.h>
 #include <QtCore/qjsonobject.h>
 #include <QtCore/qtextstream.h>
 #include <QtCore/qjsondocument.h>
+#include <QtCore/qelapsedtimer.h>
 #include "png atlas generator.hpp"
 #include "cpp atlas generator.hpp"
 #include "json atlas generator.hpp"
@@ -316,16 +323,12 @@ void parseAnimationArray(
   }
 }
 
-void parseParams(ExportParams &params, std::vector<QString> &paths, const QJsonDocument &doc) {
-  if (!doc.isObject()) {
-    throw Error{"JSON document must be an object"};
-  }
-  QJsonObject obj = doc.object();
-  
+void parseParams(ExportParams &params, std::vector<QString> &paths, QJsonObject obj) {
   params.name = getString(obj, "output name", "atlas");
   params.directory = QDir::fromNativeSeparators(getString(obj, "output directory", "."));
   params.pixelFormat = getEnum(obj, "pixel format", PixelFormat::rgba);
   params.whitepixel = getBool(obj, "whitepixel", false);
+  params.trim = getBool(obj, "trim", false);
   params.generator = parseGenerator(getString(obj, "generator", "png"));
   
   if (QJsonValue val = obj.take("animations"); val.isArray()) {
@@ -337,6 +340,238 @@ void parseParams(ExportParams &params, std::vector<QString> &paths, const QJsonD
   checkUnused("Document object", obj);
 }
 
+// ------------------------------ jobs ------------------------------
+
+struct SharedAnimation {
+  QString path;
+  QByteArray hash;
+  CelRect rect;
+  std::size_t uses = 0;
+  std::unique_ptr<Animation> anim;
+  Error error;
+};
+
+struct ExportJob {
+  ExportParams params;
+  std::vector<QString> paths;
+  QJsonObject config;
+  std::vector<std::size_t> anims;
+  std::optional<ExportCache> cache;
+  std::vector<AtlasAnimation> states;
+  std::vector<bool> cached;
+  bool upToDate = false;
+  QString stage;
+  Error error;
+  std::vector<QString> warnings;
+  double time = 0.0;
+};
+
+void parseJobs(std::vector<ExportJob> &jobs, const QJsonArray &arr) {
+  if (arr.isEmpty()) {
+    throw Error{"Document array cannot be empty"};
+  }
+  jobs.resize(static_cast<std::size_t>(arr.size()));
+  for (int j = 0; j != arr.size(); ++j) {
+    ExportJob &job = jobs[static_cast<std::size_t>(j)];
+    try {
+      if (!arr[j].isObject()) {
+        throw Error{"Document array element must be an object"};
+      }
+      job.config = arr[j].toObject();
+      parseParams(job.params, job.paths, job.config);
+    } catch (Error &err) {
+      job.stage = "configuration";
+      job.error = std::move(err);
+    }
+  }
+}
+
+template <typename Func>
+void timeJob(ExportJob &job, Func func) {
+  QElapsedTimer timer;
+  timer.start();
+  func();
+  job.time += static_cast<double>(timer.nsecsElapsed()) / 1000000.0;
+}
+
+void setJobError(ExportJob &job, const QString &stage, Error error) {
+  job.stage = stage;
+  job.error = std::move(error);
+}
+
+// Each file is hashed and loaded at most once no matter how many jobs
+// reference it
+void findSharedAnimations(std::vector<SharedAnimation> &shared, std::vector<ExportJob> &jobs) {
+  std::map<QString, std::size_t> indices;
+  for (ExportJob &job : jobs) {
+    if (job.error) continue;
+    for (const QString &path : job.paths) {
+      const auto [iter, inserted] = indices.try_emplace(
+        QFileInfo{path}.absoluteFilePath(), shared.size()
+      );
+      if (inserted) shared.emplace_back().path = path;
+      job.anims.push_back(iter->second);
+    }
+  }
+  parallelFor(shared.size(), [&](const std::size_t s) {
+    shared[s].error = hashFile(shared[s].hash, shared[s].path);
+  });
+}
+
+// Jobs with the same inputs as the previous export are skipped. The states
+// of the sprites of animations that haven't changed are read from the cache.
+// Their images are read later when they are copied into the atlas.
+void readCache(ExportJob &job, const std::vector<SharedAnimation> &shared) {
+  std::vector<QByteArray> hashes;
+  for (const std::size_t s : job.anims) {
+    if (shared[s].error) {
+      return setJobError(job, "load", shared[s].path + ": " + shared[s].error.msg());
+    }
+    hashes.push_back(shared[s].hash);
+  }
+  job.cache.emplace(job.params, job.config);
+  job.cache->setInputs(std::move(hashes));
+  if (job.cache->upToDate()) {
+    job.upToDate = true;
+    return;
+  }
+  job.states.resize(job.anims.size());
+  job.cached.resize(job.anims.size());
+  for (std::size_t a = 0; a != job.anims.size(); ++a) {
+    job.cached[a] = job.cache->readSprites(job.states[a], a, false);
+  }
+}
+
+// Only the animations that are not cached are loaded. A file that is only
+// needed by one animation is partially loaded.
+void loadSharedAnimations(std::vector<SharedAnimation> &shared, const std::vector<ExportJob> &jobs) {
+  for (const ExportJob &job : jobs) {
+    if (job.error || job.upToDate) continue;
+    for (std::size_t a = 0; a != job.anims.size(); ++a) {
+      if (job.cached[a]) continue;
+      SharedAnimation &anim = shared[job.anims[a]];
+      if (anim.uses++ == 0) {
+        anim.rect = exportRect(job.params.anims[a]);
+      } else {
+        anim.rect = {LayerIdx{0}, FrameIdx{0}, LayerIdx{-1}, FrameIdx{-1}};
+      }
+    }
+  }
+  for (SharedAnimation &anim : shared) {
+    if (anim.uses) anim.anim = std::make_unique<Animation>();
+  }
+  parallelFor(shared.size(), [&](const std::size_t s) {
+    if (!shared[s].anim) return;
+    shared[s].error = shared[s].anim->openFile(shared[s].path, shared[s].rect);
+  });
+}
+
+// The sprites of an animation are either read from the cache or rendered and
+// then written to the cache
+class JobSource final : public AtlasSource {
+public:
+  JobSource(ExportJob &job, const std::vector<SharedAnimation> &shared)
+    : job{job}, shared{shared}, warnings(job.anims.size()) {}
+  
+  Error readStates(AtlasAnimation &anim, const std::size_t a) override {
+    if (job.cached[a]) {
+      anim = std::move(job.states[a]);
+      return {};
+    }
+    return renderAnimation(anim, job.params.anims[a], *shared[job.anims[a]].anim, false);
+  }
+  
+  Error readSprites(AtlasAnimation &anim, const std::size_t a) override {
+    if (job.cached[a]) {
+      if (!job.cache->readSprites(anim, a, true)) {
+        return "Failed to read cached sprites of " + shared[job.anims[a]].path;
+      }
+      return {};
+    }
+    TRY(renderAnimation(anim, job.params.anims[a], *shared[job.anims[a]].anim, true));
+    // Failing to write to the cache only makes the next export slower
+    if (Error err = job.cache->writeSprites(anim, a); err) {
+      warnings[a] = err.msg();
+    }
+    return {};
+  }
+  
+  void addWarnings() {
+    for (QString &warning : warnings) {
+      if (!warning.isNull()) job.warnings.push_back(std::move(warning));
+    }
+  }
+
+private:
+  ExportJob &job;
+  const std::vector<SharedAnimation> &shared;
+  // The animations of a batch are read in parallel
+  std::vector<QString> warnings;
+};
+
+void exportJob(ExportJob &job, const std::vector<SharedAnimation> &shared) {
+  for (std::size_t a = 0; a != job.anims.size(); ++a) {
+    if (job.cached[a]) continue;
+    const SharedAnimation &anim = shared[job.anims[a]];
+    if (anim.error) {
+      return setJobError(job, "load", anim.path + ": " + anim.error.msg());
+    }
+  }
+  
+  JobSource source{job, shared};
+  Error err = exportTextureAtlas(job.params, source);
+  source.addWarnings();
+  job.states.clear();
+  if (err) {
+    return setJobError(job, "export", std::move(err));
+  }
+  err = job.cache->finish(job.params.generator->outputs());
+  if (err) {
+    job.warnings.push_back(err.msg());
+  }
+}
+
+// The jobs are scheduled on the thread pool. Nested parallel loops within a
+// job run on the same thread when the pool is full.
+void runJobs(std::vector<ExportJob> &jobs) {
+  std::vector<SharedAnimation> shared;
+  findSharedAnimations(shared, jobs);
+  parallelFor(jobs.size(), [&](const std::size_t j) {
+    if (jobs[j].error) return;
+    timeJob(jobs[j], [&]() { readCache(jobs[j], shared); });
+  });
+  loadSharedAnimations(shared, jobs);
+  parallelFor(jobs.size(), [&](const std::size_t j) {
+    if (jobs[j].error || jobs[j].upToDate) return;
+    timeJob(jobs[j], [&]() { exportJob(jobs[j], shared); });
+  });
+}
+
+QJsonArray jobResults(const std::vector<ExportJob> &jobs) {
+  QJsonArray results;
+  for (const ExportJob &job : jobs) {
+    QJsonObject result;
+    result.insert("output name", job.params.name);
+    result.insert("output directory", job.params.directory);
+    result.insert("success", !job.error);
+    result.insert("up to date", job.upToDate);
+    result.insert("time", job.time);
+    if (job.error) {
+      result.insert("stage", job.stage);
+      result.insert("error", job.error.msg());
+    }
+    if (!job.warnings.empty()) {
+      QJsonArray warnings;
+      for (const QString &warning : job.warnings) {
+        warnings.append(warning);
+      }
+      result.insert("warnings", warnings);
+    }
+    results.append(result);
+  }
+  return results;
+}
+
 }
 
 int cliExport(int &argc, char **argv) {
@@ -352,21 +587,39 @@ int cliExport(int &argc, char **argv) {
     return 1;
   }
   
-  ExportParams params;
-  std::vector<QString> paths;
+  std::vector<ExportJob> jobs;
   try {
-    parseParams(params, paths, doc);
+    if (doc.isArray()) {
+      parseJobs(jobs, doc.array());
+    } else if (doc.isObject()) {
+      parseJobs(jobs, QJsonArray{doc.object()});
+    } else {
+      throw Error{"JSON document must be an object or an array"};
+    }
   } catch (Error &err) {
     console << "Configuration error\n";
     console << err.msg() << '\n';
     return 1;
   }
-
-  if (Error err = exportTextureAtlas(params, paths); err) {
-    console << "Export error\n";
-    console << err.msg() << '\n';
-    return 1;
+  
+  runJobs(jobs);
+  
+  if (doc.isArray()) {
+    console << QJsonDocument{jobResults(jobs)}.toJson();
+    for (const ExportJob &job : jobs) {
+      if (job.error) return 1;
+    }
+    return 0;
   }
   
+  const ExportJob &job = jobs.front();
+  for (const QString &warning : job.warnings) {
+    console << "Export cache warning: " << warning << '\n';
+  }
+  if (job.error) {
+    console << (job.stage == "configuration" ? "Configuration error\n" : "Export error\n");
+    console << job.error.msg() << '\n';
+    return 1;
+  }
   return 0;
 }
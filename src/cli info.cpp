@@ -92,11 +92,48 @@ Error printGroups(QTextStream &console, QIODevice &dev, const AnimationInfo &inf
   return e.msg();
 }
 
-Error printLayers(QTextStream &console, QIODevice &dev, const bool json) try {
-  ChunkReader reader{dev};
-  int index = 0;
+void printLayer(QTextStream &console, const Layer &layer, const int index, const bool json) {
+  if (json) {
+    if (index == 0) {
+      console << "    ";
+    } else {
+      console << ", ";
+    }
+    console << "{\n";
+    console << "      \"name\": \"";
+    writeEscaped(console, layer.name);
+    console << "\",\n";
+    console << "      \"cels\": " << layer.cels.size() << ",\n";
+    console << "      \"visible\": " << (layer.visible ? "true" : "false") << '\n';
+    console << "    }";
+  } else {
+    console << "  Layer " << index << ":\n";
+    console << "    Name:    " << toLatinString(layer.name) << '\n';
+    console << "    Cels:    " << layer.cels.size() << '\n';
+    console << "    Visible: " << (layer.visible ? "Yes" : "No") << '\n';
+  }
+}
+
+Error printLayers(QTextStream &console, QIODevice &dev, const AnimationInfo &info, const bool json) try {
+  const qint64 pos = dev.pos();
+  std::vector<LayerIndex> index;
+  TRY(readINDX(dev, index, info));
   Layer layer;
   
+  if (!index.empty()) {
+    for (std::size_t l = 0; l != index.size(); ++l) {
+      if (!dev.seek(index[l].header)) return dev.errorString();
+      TRY(readLHDR(dev, layer));
+      printLayer(console, layer, static_cast<int>(l), json);
+    }
+    return {};
+  }
+  
+  // Files without an index have to be searched for layer headers
+  if (!dev.seek(pos)) return dev.errorString();
+  ChunkReader reader{dev};
+  int l = 0;
+  
   while (!dev.atEnd()) {
     const ChunkStart start = reader.peek();
     if (std::memcmp(start.name, chunk_layer_header, chunk_name_len) != 0) {
@@ -104,28 +141,7 @@ Error printLayers(QTextStream &console, QIODevice &dev, const bool json) try {
       continue;
     }
     TRY(readLHDR(dev, layer));
-  
-    if (json) {
-      if (index == 0) {
-        console << "    ";
-      } else {
-        console << ", ";
-      }
-      console << "{\n";
-      console << "      \"name\": \"";
-      writeEscaped(console, layer.name);
-      console << "\",\n";
-      console << "      \"cels\": " << layer.cels.size() << ",\n";
-      console << "      \"visible\": " << (layer.visible ? "true" : "false") << '\n';
-      console << "    }";
-    } else {
-      console << "  Layer " << index << ":\n";
-      console << "    Name:    " << toLatinString(layer.name) << '\n';
-      console << "    Cels:    " << layer.cels.size() << '\n';
-      console << "    Visible: " << (layer.visible ? "Yes" : "No") << '\n';
-    }
-    
-    ++index;
+    printLayer(console, layer, l++, json);
   }
   
   return {};
@@ -136,7 +152,7 @@ Error printLayers(QTextStream &console, QIODevice &dev, const bool json) try {
 Error printInfo(const QString &path, const bool groups, const bool layers, const bool json) {
   QTextStream console{stdout};
   FileReader reader;
-  TRY(reader.open(path));
+  TRY(reader.openMapped(path));
   
   AnimationInfo anim;
   TRY(readSignature(reader.dev()));
@@ -174,11 +190,11 @@ Error printInfo(const QString &path, const bool groups, const bool layers, const
   if (layers) {
     if (json) {
       console << ",\n  \"layers\": [\n";
-      TRY(printLayers(console, reader.dev(), true));
+      TRY(printLayers(console, reader.dev(), anim, true));
       console << "\n  ]";
     } else {
       console << "Layers:\n";
-      TRY(printLayers(console, reader.dev(), false));
+      TRY(printLayers(console, reader.dev(), anim, false));
     }
   }
   
@@ -115,6 +115,13 @@ Export Command
     a sprite that's just a single white pixel. This is can be used to render
     solid, untextured polygons through a textured pipeline.
     
+    The "trim" field specifies whether to remove the transparent border around
+    each sprite. Trimming is supported by the "json" and "cpp" generators when
+    the pixel format has an alpha channel. Requesting it in any other case is an
+    error. The offset of each trimmed sprite
+    within the untrimmed sprite and the size of the untrimmed sprite are written
+    to "trims" in the json atlas and to sprite_trims in the cpp atlas.
+    
     The "generator" field specifies which texture atlas generator to use. The
     list of valid values for this field are below.
     
@@ -135,6 +142,7 @@ Export Command
       "output directory": ".",
       "pixel format": "rgba",
       "whitepixel": false,
+      "trim": false,
       "generator": "png",
       "animations": ["path/to/file.animera"]
     }
@@ -225,6 +233,7 @@ Export Command
       "output directory": ".",
       "pixel format": "rgba",
       "whitepixel": false,
+      "trim": false,
       "generator": "png",
       "animations": [
         {
@@ -240,7 +249,39 @@ Export Command
           "composite": true
         }
       ]
-    })";
+    }
+    
+    The document can also be an array of the objects described above. Each
+    object is a separate job that produces its own atlas. The jobs are exported
+    in parallel and a file that is referenced by more than one job is only
+    loaded once. When the document is an array, the result of each job is
+    written to stdout as a JSON array in the same order as the jobs. Each
+    element has these fields:
+    
+    {
+      "output name": "atlas",
+      "output directory": ".",
+      "success": false,
+      "up to date": false,
+      "time": 12.5,
+      "stage": "export",
+      "error": "Sprite name collision \"player\""
+    }
+    
+    The "time" field is the time taken to export the atlas in milliseconds. The
+    "stage" and "error" fields are only present if the job failed. The "stage"
+    field is one of "configuration", "load" or "export".
+    
+    Each atlas has a cache in the output directory. The cache for the "atlas"
+    output name is the "atlas.animera-cache" directory. It records hashes of
+    the animation files and of the configuration of the previous export, and
+    the size and modification time of the files that it wrote. If none of
+    them have changed, the atlas is not exported again and the "up to date"
+    field is true. Otherwise, the sprites of the animations that haven't
+    changed are read from the cache instead of being rendered again. Deleting
+    the cache directory forces the atlas to be exported again. Failing to
+    write to the cache doesn't fail the export. A warning is printed instead
+    or added to the "warnings" array of the result of the job.)";
 
 }
 
@@ -299,11 +340,13 @@ Error CLI::parseArgs(docopt::Options &flags) const {
 int CLI::execDefault() const {
   Application app{argc, argv};
   app.waitForOpenEvent();
+  app.recoverUntitled();
   return app.exec();
 }
 
 int CLI::execOpen(const docopt::Options &flags) const {
   Application app{argc, argv};
   app.openFile(toLatinString(flags.at("<file>").asString()));
+  app.recoverUntitled();
   return app.exec();
 }
@@ -0,0 +1,333 @@
+﻿//
+//  composite kernels.cpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#include "composite kernels.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#  define SIMD_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define TARGET_AVX2
+#  else
+#    define TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#else
+#  define SIMD_X86 0
+#endif
+
+namespace {
+
+/*
+The source-over operator uses the factors aF = 255 and bF = 255 - srcA. The
+weights of the source and destination are
+
+  wA = srcA * aF
+  wB = dstA * bF
+
+The resulting alpha is (wA + wB) / 255 and each color channel is
+
+  (wA * src + wB * dst) / (wA + wB)
+
+The result is transparent black if the sum of the weights is zero.
+*/
+
+struct Weights {
+  std::uint32_t a, b, sum;
+};
+
+Weights getWeights(const std::uint32_t srcA, const std::uint32_t dstA) {
+  const std::uint32_t a = srcA * 255;
+  const std::uint32_t b = dstA * (255 - srcA);
+  return {a, b, a + b};
+}
+
+std::uint32_t blendChannel(const Weights w, const std::uint32_t src, const std::uint32_t dst) {
+  return (w.a * src + w.b * dst) / w.sum;
+}
+
+PixelRgba overRgba(const PixelRgba dst, const PixelRgba src) {
+  const Weights w = getWeights(src >> 24, dst >> 24);
+  if (w.sum == 0) return 0;
+  PixelRgba result = (w.sum / 255) << 24;
+  for (int shift = 0; shift != 24; shift += 8) {
+    result |= blendChannel(w, (src >> shift) & 255, (dst >> shift) & 255) << shift;
+  }
+  return result;
+}
+
+// The gray channel is the first byte and the alpha channel is the second
+void overGray(std::uint8_t *dst, const std::uint8_t *src) {
+  const Weights w = getWeights(src[1], dst[1]);
+  if (w.sum == 0) {
+    dst[0] = dst[1] = 0;
+  } else {
+    dst[0] = static_cast<std::uint8_t>(blendChannel(w, src[0], dst[0]));
+    dst[1] = static_cast<std::uint8_t>(w.sum / 255);
+  }
+}
+
+void compositeRgbaScalar(PixelRgba *dst, const PixelRgba *src, const std::size_t size) {
+  for (std::size_t i = 0; i != size; ++i) {
+    dst[i] = overRgba(dst[i], src[i]);
+  }
+}
+
+void compositeGrayScalar(PixelGray *dst, const PixelGray *src, const std::size_t size) {
+  static_assert(sizeof(PixelGray) == 2);
+  auto *dstBytes = reinterpret_cast<std::uint8_t *>(dst);
+  const auto *srcBytes = reinterpret_cast<const std::uint8_t *>(src);
+  for (std::size_t i = 0; i != size; ++i) {
+    overGray(dstBytes + 2 * i, srcBytes + 2 * i);
+  }
+}
+
+#if SIMD_X86
+
+/*
+The SIMD kernels do the same arithmetic in single-precision floats. Every
+product and sum is an integer less than 2^24 so it is represented exactly.
+The quotients are at most 255 and the fractional part of an inexact quotient
+is at least 1/65025. That is larger than the gap between floats below 256 so
+truncating the rounded quotient gives the same result as integer division.
+
+On x86, a gray-alpha pixel loaded as a 16-bit integer has the gray channel in
+the low byte.
+*/
+
+struct Weights128 {
+  __m128 a, b, sum;
+};
+
+Weights128 getWeights(const __m128i srcA, const __m128i dstA) {
+  const __m128 max = _mm_set1_ps(255.0f);
+  const __m128 srcAF = _mm_cvtepi32_ps(srcA);
+  const __m128 a = _mm_mul_ps(srcAF, max);
+  const __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(dstA), _mm_sub_ps(max, srcAF));
+  return {a, b, _mm_add_ps(a, b)};
+}
+
+__m128i blendChannel(const Weights128 w, const __m128i src, const __m128i dst) {
+  const __m128 srcW = _mm_mul_ps(w.a, _mm_cvtepi32_ps(src));
+  const __m128 dstW = _mm_mul_ps(w.b, _mm_cvtepi32_ps(dst));
+  return _mm_cvttps_epi32(_mm_div_ps(_mm_add_ps(srcW, dstW), w.sum));
+}
+
+__m128i blendAlpha(const Weights128 w) {
+  return _mm_cvttps_epi32(_mm_div_ps(w.sum, _mm_set1_ps(255.0f)));
+}
+
+__m128i maskEmpty(const Weights128 w, const __m128i result) {
+  const __m128 empty = _mm_cmpeq_ps(w.sum, _mm_setzero_ps());
+  return _mm_andnot_si128(_mm_castps_si128(empty), result);
+}
+
+template <int Shift>
+__m128i channel(const __m128i pixels) {
+  return _mm_and_si128(_mm_srli_epi32(pixels, Shift), _mm_set1_epi32(255));
+}
+
+__m128i overRgba(const __m128i dst, const __m128i src) {
+  const Weights128 w = getWeights(_mm_srli_epi32(src, 24), _mm_srli_epi32(dst, 24));
+  __m128i result = _mm_slli_epi32(blendAlpha(w), 24);
+  result = _mm_or_si128(result, blendChannel(w, channel<0>(src), channel<0>(dst)));
+  result = _mm_or_si128(result, _mm_slli_epi32(blendChannel(w, channel<8>(src), channel<8>(dst)), 8));
+  result = _mm_or_si128(result, _mm_slli_epi32(blendChannel(w, channel<16>(src), channel<16>(dst)), 16));
+  return maskEmpty(w, result);
+}
+
+// Each 32-bit lane holds a gray-alpha pixel in its low 16 bits
+__m128i overGray(const __m128i dst, const __m128i src) {
+  const Weights128 w = getWeights(_mm_srli_epi32(src, 8), _mm_srli_epi32(dst, 8));
+  __m128i result = _mm_slli_epi32(blendAlpha(w), 8);
+  result = _mm_or_si128(result, blendChannel(w, channel<0>(src), channel<0>(dst)));
+  return maskEmpty(w, result);
+}
+
+// _mm_packs_epi32 saturates signed integers so the pixels are sign extended
+__m128i packGray(const __m128i lo, const __m128i hi) {
+  return _mm_packs_epi32(
+    _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16),
+    _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16)
+  );
+}
+
+void compositeRgbaSSE2(PixelRgba *dst, const PixelRgba *src, const std::size_t size) {
+  static_assert(sizeof(PixelRgba) == 4);
+  std::size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    auto *dstVec = reinterpret_cast<__m128i *>(dst + i);
+    const auto *srcVec = reinterpret_cast<const __m128i *>(src + i);
+    _mm_storeu_si128(dstVec, overRgba(_mm_loadu_si128(dstVec), _mm_loadu_si128(srcVec)));
+  }
+  compositeRgbaScalar(dst + i, src + i, size - i);
+}
+
+void compositeGraySSE2(PixelGray *dst, const PixelGray *src, const std::size_t size) {
+  const __m128i zero = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    auto *dstVec = reinterpret_cast<__m128i *>(dst + i);
+    const auto *srcVec = reinterpret_cast<const __m128i *>(src + i);
+    const __m128i dstPx = _mm_loadu_si128(dstVec);
+    const __m128i srcPx = _mm_loadu_si128(srcVec);
+    const __m128i lo = overGray(_mm_unpacklo_epi16(dstPx, zero), _mm_unpacklo_epi16(srcPx, zero));
+    const __m128i hi = overGray(_mm_unpackhi_epi16(dstPx, zero), _mm_unpackhi_epi16(srcPx, zero));
+    _mm_storeu_si128(dstVec, packGray(lo, hi));
+  }
+  compositeGrayScalar(dst + i, src + i, size - i);
+}
+
+struct Weights256 {
+  __m256 a, b, sum;
+};
+
+TARGET_AVX2 Weights256 getWeights(const __m256i srcA, const __m256i dstA) {
+  const __m256 max = _mm256_set1_ps(255.0f);
+  const __m256 srcAF = _mm256_cvtepi32_ps(srcA);
+  const __m256 a = _mm256_mul_ps(srcAF, max);
+  const __m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(dstA), _mm256_sub_ps(max, srcAF));
+  return {a, b, _mm256_add_ps(a, b)};
+}
+
+TARGET_AVX2 __m256i blendChannel(const Weights256 &w, const __m256i src, const __m256i dst) {
+  const __m256 srcW = _mm256_mul_ps(w.a, _mm256_cvtepi32_ps(src));
+  const __m256 dstW = _mm256_mul_ps(w.b, _mm256_cvtepi32_ps(dst));
+  return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_add_ps(srcW, dstW), w.sum));
+}
+
+TARGET_AVX2 __m256i blendAlpha(const Weights256 &w) {
+  return _mm256_cvttps_epi32(_mm256_div_ps(w.sum, _mm256_set1_ps(255.0f)));
+}
+
+TARGET_AVX2 __m256i maskEmpty(const Weights256 &w, const __m256i result) {
+  const __m256 empty = _mm256_cmp_ps(w.sum, _mm256_setzero_ps(), _CMP_EQ_OQ);
+  return _mm256_andnot_si256(_mm256_castps_si256(empty), result);
+}
+
+template <int Shift>
+TARGET_AVX2 __m256i channel(const __m256i pixels) {
+  return _mm256_and_si256(_mm256_srli_epi32(pixels, Shift), _mm256_set1_epi32(255));
+}
+
+TARGET_AVX2 __m256i overRgba(const __m256i dst, const __m256i src) {
+  const Weights256 w = getWeights(_mm256_srli_epi32(src, 24), _mm256_srli_epi32(dst, 24));
+  __m256i result = _mm256_slli_epi32(blendAlpha(w), 24);
+  result = _mm256_or_si256(result, blendChannel(w, channel<0>(src), channel<0>(dst)));
+  result = _mm256_or_si256(result, _mm256_slli_epi32(blendChannel(w, channel<8>(src), channel<8>(dst)), 8));
+  result = _mm256_or_si256(result, _mm256_slli_epi32(blendChannel(w, channel<16>(src), channel<16>(dst)), 16));
+  return maskEmpty(w, result);
+}
+
+TARGET_AVX2 __m256i overGray(const __m256i dst, const __m256i src) {
+  const Weights256 w = getWeights(_mm256_srli_epi32(src, 8), _mm256_srli_epi32(dst, 8));
+  __m256i result = _mm256_slli_epi32(blendAlpha(w), 8);
+  result = _mm256_or_si256(result, blendChannel(w, channel<0>(src), channel<0>(dst)));
+  return maskEmpty(w, result);
+}
+
+// Unpacking and packing both work within 128-bit lanes so the order of the
+// pixels is preserved
+TARGET_AVX2 __m256i packGray(const __m256i lo, const __m256i hi) {
+  return _mm256_packs_epi32(
+    _mm256_srai_epi32(_mm256_slli_epi32(lo, 16), 16),
+    _mm256_srai_epi32(_mm256_slli_epi32(hi, 16), 16)
+  );
+}
+
+TARGET_AVX2 void compositeRgbaAVX2(PixelRgba *dst, const PixelRgba *src, const std::size_t size) {
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    auto *dstVec = reinterpret_cast<__m256i *>(dst + i);
+    const auto *srcVec = reinterpret_cast<const __m256i *>(src + i);
+    _mm256_storeu_si256(dstVec, overRgba(_mm256_loadu_si256(dstVec), _mm256_loadu_si256(srcVec)));
+  }
+  compositeRgbaSSE2(dst + i, src + i, size - i);
+}
+
+TARGET_AVX2 void compositeGrayAVX2(PixelGray *dst, const PixelGray *src, const std::size_t size) {
+  const __m256i zero = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    auto *dstVec = reinterpret_cast<__m256i *>(dst + i);
+    const auto *srcVec = reinterpret_cast<const __m256i *>(src + i);
+    const __m256i dstPx = _mm256_loadu_si256(dstVec);
+    const __m256i srcPx = _mm256_loadu_si256(srcVec);
+    const __m256i lo = overGray(_mm256_unpacklo_epi16(dstPx, zero), _mm256_unpacklo_epi16(srcPx, zero));
+    const __m256i hi = overGray(_mm256_unpackhi_epi16(dstPx, zero), _mm256_unpackhi_epi16(srcPx, zero));
+    _mm256_storeu_si256(dstVec, packGray(lo, hi));
+  }
+  compositeGraySSE2(dst + i, src + i, size - i);
+}
+
+#endif
+
+SimdLevel detectSimdLevel() {
+  #if SIMD_X86
+  #if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] >= 7) {
+    __cpuidex(info, 7, 0);
+    const bool avx2 = info[1] & (1 << 5);
+    __cpuid(info, 1);
+    const bool osxsave = info[2] & (1 << 27);
+    if (avx2 && osxsave && (_xgetbv(0) & 6) == 6) return SimdLevel::avx2;
+  }
+  #else
+  if (__builtin_cpu_supports("avx2")) return SimdLevel::avx2;
+  #endif
+  // SSE2 is part of x86-64
+  return SimdLevel::sse2;
+  #else
+  return SimdLevel::scalar;
+  #endif
+}
+
+}
+
+SimdLevel maxSimdLevel() {
+  static const SimdLevel level = detectSimdLevel();
+  return level;
+}
+
+void compositeRowRgba(
+  PixelRgba *dst,
+  const PixelRgba *src,
+  const std::size_t size,
+  const SimdLevel level
+) {
+  switch (std::min(level, maxSimdLevel())) {
+    #if SIMD_X86
+    case SimdLevel::avx2:
+      return compositeRgbaAVX2(dst, src, size);
+    case SimdLevel::sse2:
+      return compositeRgbaSSE2(dst, src, size);
+    #endif
+    default:
+      return compositeRgbaScalar(dst, src, size);
+  }
+}
+
+void compositeRowGray(
+  PixelGray *dst,
+  const PixelGray *src,
+  const std::size_t size,
+  const SimdLevel level
+) {
+  switch (std::min(level, maxSimdLevel())) {
+    #if SIMD_X86
+    case SimdLevel::avx2:
+      return compositeGrayAVX2(dst, src, size);
+    case SimdLevel::sse2:
+      return compositeGraySSE2(dst, src, size);
+    #endif
+    default:
+      return compositeGrayScalar(dst, src, size);
+  }
+}
@@ -0,0 +1,30 @@
+﻿//
+//  composite kernels.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_composite_kernels_hpp
+#define animera_composite_kernels_hpp
+
+#include "image.hpp"
+
+enum class SimdLevel {
+  scalar,
+  sse2,
+  avx2
+};
+
+/// The highest level of SIMD that is supported by the CPU
+SimdLevel maxSimdLevel();
+
+/// Composite a row of pixels over another row of pixels with the source-over
+/// operator on straight alpha. The result is identical to gfx::porterDuff with
+/// gfx::mode_src_over at every level of SIMD. Levels that aren't supported by
+/// the CPU fall back to the highest supported level.
+void compositeRowRgba(PixelRgba *, const PixelRgba *, std::size_t, SimdLevel = maxSimdLevel());
+void compositeRowGray(PixelGray *, const PixelGray *, std::size_t, SimdLevel = maxSimdLevel());
+
+#endif
@@ -9,8 +9,11 @@
 #include "composite.hpp"
 
 #include <limits>
+#include "parallel.hpp"
 #include "scope time.hpp"
 #include "config colors.hpp"
+#include "config geometry.hpp"
+#include "composite kernels.hpp"
 #include <Graphics/copy.hpp>
 #include <Graphics/fill.hpp>
 #include <Graphics/mask.hpp>
@@ -37,37 +40,191 @@ void copy(Surface<DstFmt> dst, const CelImage &cel, const QPoint dstPos, SrcFmt
 }
 
 template <typename DstFmt, typename SrcFmt>
-void composite(Surface<DstFmt> dst, const CelImage &cel, const QPoint dstPos, SrcFmt srcFmt) {
-  gfx::porterDuffRegion(
-    gfx::mode_src_over,
-    dst,
-    makeCSurface<gfx::Pixel<SrcFmt>>(cel.img),
-    DstFmt{},
-    srcFmt,
-    convert(cel.pos - dstPos)
-  );
+constexpr bool has_kernel =
+  (std::is_same_v<DstFmt, FmtRgba> && (
+    std::is_same_v<SrcFmt, FmtRgba> ||
+    std::is_same_v<SrcFmt, FmtIndex> ||
+    std::is_same_v<SrcFmt, FmtGray>
+  )) ||
+  (std::is_same_v<DstFmt, FmtGray> && std::is_same_v<SrcFmt, FmtGray>);
+
+template <typename DstFmt, typename SrcFmt>
+void convertRow(
+  gfx::Pixel<DstFmt> *dst,
+  const gfx::Pixel<SrcFmt> *src,
+  const int width,
+  const PaletteCSpan palette
+) {
+  if constexpr (std::is_same_v<SrcFmt, FmtIndex>) {
+    for (int x = 0; x != width; ++x) {
+      dst[x] = static_cast<PixelRgba>(palette[src[x]]);
+    }
+  } else {
+    for (int x = 0; x != width; ++x) {
+      dst[x] = DstFmt::pixel(SrcFmt::color(src[x]));
+    }
+  }
 }
 
+// The rectangle is the part of the cel that is within the destination image.
+// Source pixels that aren't in the destination format are converted one row
+// at a time before being composited.
 template <typename DstFmt, typename SrcFmt>
-void compositeFrame(Surface<DstFmt> dst, const Frame &frame, const QPoint dstPos, SrcFmt srcFmt) {
+void compositeRows(QImage &image, const CelImage &cel, const QRect rect, const PaletteCSpan palette) {
+  using DstPixel = gfx::Pixel<DstFmt>;
+  using SrcPixel = gfx::Pixel<SrcFmt>;
+  
+  uchar *dstBits = image.bits() + rect.x() * sizeof(DstPixel);
+  const qsizetype dstPitch = image.bytesPerLine();
+  const int srcX = rect.x() - cel.pos.x();
+  std::vector<DstPixel> converted;
+  if constexpr (!std::is_same_v<DstFmt, SrcFmt>) {
+    converted.resize(rect.width());
+  }
+  
+  for (int y = rect.top(); y <= rect.bottom(); ++y) {
+    auto *dst = reinterpret_cast<DstPixel *>(dstBits + y * dstPitch);
+    const auto *src = reinterpret_cast<const SrcPixel *>(
+      cel.img.constScanLine(y - cel.pos.y())
+    ) + srcX;
+    const DstPixel *row;
+    if constexpr (std::is_same_v<DstFmt, SrcFmt>) {
+      row = src;
+    } else {
+      convertRow<DstFmt, SrcFmt>(converted.data(), src, rect.width(), palette);
+      row = converted.data();
+    }
+    if constexpr (std::is_same_v<DstFmt, FmtRgba>) {
+      compositeRowRgba(dst, row, rect.width());
+    } else {
+      compositeRowGray(dst, row, rect.width());
+    }
+  }
+}
+
+template <typename DstFmt, typename SrcFmt>
+void composite(
+  QImage &image,
+  Surface<DstFmt> dst,
+  const CelImage &cel,
+  const QRect rect,
+  const QPoint dstPos,
+  SrcFmt srcFmt,
+  const PaletteCSpan palette
+) {
+  if constexpr (has_kernel<DstFmt, SrcFmt>) {
+    compositeRows<DstFmt, SrcFmt>(image, cel, rect, palette);
+  } else {
+    gfx::porterDuffRegion(
+      gfx::mode_src_over,
+      dst,
+      makeCSurface<gfx::Pixel<SrcFmt>>(cel.img),
+      DstFmt{},
+      srcFmt,
+      convert(cel.pos - dstPos)
+    );
+  }
+}
+
+// Determine whether every pixel of the cel within the rectangle is opaque.
+// This stops at the first pixel that isn't so it's usually cheap.
+template <typename SrcFmt>
+bool opaqueRegion(const CelImage &cel, const QRect rect, SrcFmt srcFmt) {
+  using SrcPixel = gfx::Pixel<SrcFmt>;
+  const int srcX = rect.x() - cel.pos.x();
+  for (int y = rect.top(); y <= rect.bottom(); ++y) {
+    const auto *src = reinterpret_cast<const SrcPixel *>(
+      cel.img.constScanLine(y - cel.pos.y())
+    ) + srcX;
+    for (int x = 0; x != rect.width(); ++x) {
+      if (srcFmt.color(src[x]).a != 255) return false;
+    }
+  }
+  return true;
+}
+
+template <typename DstFmt, typename SrcFmt>
+void compositeTile(
+  QImage &image,
+  const Frame &frame,
+  const QRect tile,
+  SrcFmt srcFmt,
+  const PaletteCSpan palette
+) {
   // Layer 0 is on top of layer 1
-  const QRect dstRect = {dstPos, convert(dst.size())};
-  for (std::size_t c = frame.size() - 1; c != ~std::size_t{}; --c) {
+  // Cels underneath an opaque cel that covers the tile are not visible
+  std::size_t bottom = frame.size();
+  for (std::size_t c = 0; c != frame.size(); ++c) {
+    const CelImage &cel = *frame[c];
+    if (cel.rect().contains(tile) && opaqueRegion(cel, tile, srcFmt)) {
+      bottom = c + 1;
+      break;
+    }
+  }
+  
+  Surface<DstFmt> dst = makeSurface<gfx::Pixel<DstFmt>>(image).view(convert(tile));
+  const QPoint dstPos = tile.topLeft();
+  QRect drawn;
+  for (std::size_t c = bottom - 1; c != ~std::size_t{}; --c) {
     const CelImage &cel = *frame[c];
-    const QRect celRect = dstRect.intersected(cel.rect());
+    const QRect celRect = tile.intersected(cel.rect());
     if (celRect.isEmpty()) continue;
-    bool overlap = false;
-    for (std::size_t d = c + 1; d != frame.size(); ++d) {
-      if (celRect.intersects(frame[d]->rect())) {
-        overlap = true;
-        break;
-      }
+    if (drawn.isEmpty() && celRect != tile) {
+      gfx::fill(dst);
     }
-    if (overlap) {
-      composite<DstFmt>(dst, cel, dstPos, srcFmt);
+    if (celRect.intersects(drawn)) {
+      composite<DstFmt>(image, dst, cel, celRect, dstPos, srcFmt, palette);
     } else {
       copy<DstFmt>(dst, cel, dstPos, srcFmt);
     }
+    drawn |= celRect;
+  }
+  if (drawn.isEmpty()) {
+    gfx::fill(dst);
+  }
+}
+
+// The rectangle is split into tiles on a fixed grid so that each tile only
+// blends the cels that are visible within it.
+template <typename DstFmt, typename SrcFmt>
+void compositeFrame(
+  QImage &image,
+  const Frame &frame,
+  const QRect rect,
+  SrcFmt srcFmt,
+  const PaletteCSpan palette
+) {
+  constexpr int size = glob_composite_tile;
+  const int left = rect.left() - rect.left() % size;
+  const int top = rect.top() - rect.top() % size;
+  for (int y = top; y <= rect.bottom(); y += size) {
+    for (int x = left; x <= rect.right(); x += size) {
+      const QRect tile = QRect{x, y, size, size}.intersected(rect);
+      compositeTile<DstFmt>(image, frame, tile, srcFmt, palette);
+    }
+  }
+}
+
+template <typename Fmt>
+void compositeRect(
+  QImage &dst,
+  const PaletteCSpan palette,
+  const Frame &frame,
+  const Format format,
+  const QRect rect
+) {
+  switch (format) {
+    case Format::rgba:
+      compositeFrame<Fmt>(dst, frame, rect, FmtRgba{}, palette);
+      break;
+    case Format::index:
+      static_assert(sizeof(PixelVar) == sizeof(PixelRgba));
+      compositeFrame<Fmt>(dst, frame, rect, FmtIndex{&palette[0].underlying()}, palette);
+      break;
+    case Format::gray:
+      compositeFrame<Fmt>(dst, frame, rect, FmtGray{}, palette);
+      break;
+    default: Q_UNREACHABLE();
   }
 }
 
@@ -85,27 +242,90 @@ void compositeFrame(
   
   rect = rect.intersected(dst.rect());
   if (rect.isEmpty()) return;
-  auto dstSurface = makeSurface<gfx::Pixel<Fmt>>(dst).view(convert(rect));
+  compositeRect<Fmt>(dst, palette, frame, format, rect);
+}
+
+template <typename Fmt>
+void compositeFrameParallel(
+  QImage &dst,
+  PaletteCSpan palette,
+  const Frame &frame,
+  const Format format,
+  QRect rect
+) {
+  SCOPE_TIME("compositeFrameParallel");
+  
+  rect = rect.intersected(dst.rect());
+  if (rect.isEmpty()) return;
   
-  gfx::fill(dstSurface);
+  // Bands are aligned to the tile grid so that they don't share any tiles.
+  // Each band gets its own QImage over the same pixels because calling
+  // QImage::bits on a shared QImage from multiple threads is a data race.
+  constexpr int size = glob_composite_tile;
+  const int top = rect.top() - rect.top() % size;
+  const int bands = (rect.bottom() - top) / size + 1;
+  uchar *bits = dst.bits();
+  parallelFor(bands, [&](const std::size_t b) {
+    QImage band{bits, dst.width(), dst.height(), dst.bytesPerLine(), dst.format()};
+    const QRect bandRect = QRect{
+      rect.left(), top + static_cast<int>(b) * size, rect.width(), size
+    }.intersected(rect);
+    compositeRect<Fmt>(band, palette, frame, format, bandRect);
+  });
+}
+
+template <typename Fmt>
+void compositeOver(
+  QImage &dst,
+  PaletteCSpan palette,
+  const CelImage &cel,
+  const Format format,
+  QRect rect
+) {
+  rect = rect.intersected(dst.rect()).intersected(cel.rect());
+  if (rect.isEmpty()) return;
+  auto dstSurface = makeSurface<gfx::Pixel<Fmt>>(dst).view(convert(rect));
   
   switch (format) {
     case Format::rgba:
-      compositeFrame<Fmt>(dstSurface, frame, rect.topLeft(), FmtRgba{});
+      composite<Fmt>(dst, dstSurface, cel, rect, rect.topLeft(), FmtRgba{}, palette);
       break;
     case Format::index:
-      static_assert(sizeof(PixelVar) == sizeof(PixelRgba));
-      compositeFrame<Fmt>(dstSurface, frame, rect.topLeft(), FmtIndex{&palette[0].underlying()});
+      composite<Fmt>(dst, dstSurface, cel, rect, rect.topLeft(), FmtIndex{&palette[0].underlying()}, palette);
       break;
     case Format::gray:
-      compositeFrame<Fmt>(dstSurface, frame, rect.topLeft(), FmtGray{});
+      composite<Fmt>(dst, dstSurface, cel, rect, rect.topLeft(), FmtGray{}, palette);
       break;
     default: Q_UNREACHABLE();
   }
 }
 
+bool opaqueCover(const Frame &frame, const PaletteCSpan palette, const Format format, const QRect rect) {
+  for (const CelImage *cel : frame) {
+    if (!cel->rect().contains(rect)) continue;
+    bool opaque;
+    switch (format) {
+      case Format::rgba:
+        opaque = opaqueRegion(*cel, rect, FmtRgba{});
+        break;
+      case Format::index:
+        opaque = opaqueRegion(*cel, rect, FmtIndex{&palette[0].underlying()});
+        break;
+      case Format::gray:
+        opaque = opaqueRegion(*cel, rect, FmtGray{});
+        break;
+      default: Q_UNREACHABLE();
+    }
+    if (opaque) return true;
+  }
+  return false;
+}
+
 template void compositeFrame<FmtRgba>(QImage &, PaletteCSpan, const Frame &, Format, QRect);
 template void compositeFrame<FmtGray>(QImage &, PaletteCSpan, const Frame &, Format, QRect);
+template void compositeFrameParallel<FmtRgba>(QImage &, PaletteCSpan, const Frame &, Format, QRect);
+template void compositeFrameParallel<FmtGray>(QImage &, PaletteCSpan, const Frame &, Format, QRect);
+template void compositeOver<FmtRgba>(QImage &, PaletteCSpan, const CelImage &, Format, QRect);
 
 void blitImage(QImage &dst, const QImage &src, const QPoint pos) {
   visitSurfaces(dst, src, [pos](auto dst, auto src) {
@@ -17,6 +17,16 @@
 /// a single image
 template <typename Fmt = FmtRgba>
 void compositeFrame(QImage &, PaletteCSpan, const Frame &, Format, QRect);
+/// Same as compositeFrame but the rectangle is split into bands of rows that
+/// are composited on the thread pool
+template <typename Fmt = FmtRgba>
+void compositeFrameParallel(QImage &, PaletteCSpan, const Frame &, Format, QRect);
+/// Composite a single cel over the rectangle of an image without clearing it
+template <typename Fmt = FmtRgba>
+void compositeOver(QImage &, PaletteCSpan, const CelImage &, Format, QRect);
+/// Determine whether one of the cels in the frame is opaque over the whole
+/// rectangle. The cels underneath it aren't visible within the rectangle.
+bool opaqueCover(const Frame &, PaletteCSpan, Format, QRect);
 
 /// Copy an image onto another image at a position
 void blitImage(QImage &, const QImage &, QPoint);
@@ -35,6 +35,7 @@ constexpr int       glob_font_pt = 8_px; // 8 pt for 72 dpi
 #endif
 
 constexpr QSize     glob_window_size = {640_px, 360_px};
+constexpr int       glob_composite_tile = 64; // pixels
 
 // ---------------------------- global dimensions --------------------------- //
 
@@ -187,7 +188,11 @@ constexpr WidgetRect stat_rect = addMargins(textBoxRect(48));
 
 constexpr int       edit_min_scale = 1;
 constexpr int       edit_max_scale = 64;
-constexpr int       edit_undo_stack = 32;
+constexpr std::size_t edit_undo_budget = 64 * 1024 * 1024; // bytes
+constexpr int       edit_undo_tile = 64; // pixels
+constexpr std::size_t edit_frame_cache = 256 * 1024 * 1024; // bytes
+constexpr int       edit_parallel_composite = 256 * 256; // pixels
+constexpr std::size_t edit_timeline_journal = 256; // edits
 
 // ------------------------------ color picker ------------------------------ //
 
@@ -266,6 +271,8 @@ constexpr WidgetRect init_button_rect = textBoxRect(8);
 // ------------------------------ export dialog ----------------------------- //
 
 constexpr IntRange   expt_scale = {-64, 64, 1};
+constexpr std::size_t expt_render_budget = 256 * 1024 * 1024; // bytes
+constexpr int        expt_cache_version = 2; // increment when the output changes
 
 // ------------------------------ error dialog ------------------------------ //
 
@@ -275,6 +282,11 @@ constexpr int        erro_wrap_width = 40;
 
 constexpr int        keys_width = 20;
 
+// -------------------------------- autosave -------------------------------- //
+
+constexpr int        auto_interval = 60 * 1000; // milliseconds
+constexpr int        auto_retry_interval = 5 * 1000; // milliseconds
+
 // ------------------------------- file format ------------------------------ //
 
 constexpr std::size_t file_sig_len = 8;
@@ -287,6 +299,8 @@ constexpr char chunk_groups[chunk_name_len + 1] = "GRPS";
 constexpr char chunk_layer_header[chunk_name_len + 1] = "LHDR";
 constexpr char chunk_cel_header[chunk_name_len + 1] = "CHDR";
 constexpr char chunk_cel_data[chunk_name_len + 1] = "CDAT";
+constexpr char chunk_cel_reference[chunk_name_len + 1] = "CREF";
+constexpr char chunk_index[chunk_name_len + 1] = "INDX";
 constexpr char chunk_anim_end[chunk_name_len + 1] = "AEND";
 
 constexpr std::size_t file_buff_size = 1 << 15;
@@ -58,6 +58,10 @@ inline const QString key_export_frame = "CTRL+SHIFT+E";
 inline const QString key_export_cel = "CTRL+ALT+E";
 inline const QString key_import_cel = "CTRL+ALT+I";
 
+// edit
+constexpr auto       key_undo_edit = QKeySequence::Undo;
+constexpr auto       key_redo_edit = QKeySequence::Redo;
+
 // layer
 inline const QString key_new_layer = "SHIFT+N";
 inline const QString key_delete_layer = "SHIFT+BACKSPACE";
@@ -88,6 +88,15 @@ struct alignas(std::uint64_t) SpriteRect {
 };
 )";
 
+constexpr char sprite_trim_def[] = R"(
+// The position of the sprite within the untrimmed image and the size of the
+// untrimmed image
+struct alignas(std::uint64_t) SpriteTrim {
+  std::uint16_t x = 0, y = 0;
+  std::uint16_t w = 0, h = 0;
+};
+)";
+
 constexpr char sprite_rect_operators[] = R"(
 [[nodiscard]] constexpr bool operator==(const SpriteRect a, const SpriteRect b) noexcept {
   return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
@@ -633,6 +642,7 @@ Error CppAtlasGenerator::beginAtlas(const AtlasInfo &info) {
   TRY(BasicAtlasGenerator::beginAtlas(info));
   enumeration = "  null_ = 0,\n";
   array = "  SpriteRect{},\n";
+  trimArray = "  SpriteTrim{},\n";
   atlasName = info.name;
   atlasDir = info.directory;
   return {};
@@ -644,11 +654,16 @@ QString CppAtlasGenerator::endNames() {
 }
 
 Error CppAtlasGenerator::endAtlas() {
+  TRY(endImages());
   appendName("count_", packer.count());
   TRY(writeCpp());
   return writeHpp();
 }
 
+std::vector<QString> CppAtlasGenerator::outputs() const {
+  return {atlasDir + '/' + atlasName + ".cpp", atlasDir + '/' + atlasName + ".hpp"};
+}
+
 void CppAtlasGenerator::appendName(const QString &name, const std::size_t i) {
   enumeration += "  ";
   enumeration += name;
@@ -673,6 +688,18 @@ void CppAtlasGenerator::appendRect(const QRect rect) {
   }
 }
 
+void CppAtlasGenerator::appendTrim(const QPoint offset, const QSize size) {
+  trimArray += "  SpriteTrim{";
+  trimArray += QString::number(offset.x());
+  trimArray += ", ";
+  trimArray += QString::number(offset.y());
+  trimArray += ", ";
+  trimArray += QString::number(size.width());
+  trimArray += ", ";
+  trimArray += QString::number(size.height());
+  trimArray += "},\n";
+}
+
 void CppAtlasGenerator::fixName(QString &name, std::array<int, 4> &positions) {
   for (QChar &ch : name) {
     if (!ch.isLetterOrNumber()) {
@@ -756,6 +783,9 @@ Error CppAtlasGenerator::writeCpp() {
   stream << '\n';
   stream << "namespace animera {\n";
   stream << sprite_rect_def;
+  if (trim) {
+    stream << sprite_trim_def;
+  }
   stream << '\n';
   stream << "inline namespace " << nameSpace << " {\n";
   stream << '\n';
@@ -775,6 +805,12 @@ Error CppAtlasGenerator::writeCpp() {
   stream << "extern const SpriteRect sprite_rects[] = {\n";
   stream << array;
   stream << "};\n";
+  if (trim) {
+    stream << '\n';
+    stream << "extern const SpriteTrim sprite_trims[] = {\n";
+    stream << trimArray;
+    stream << "};\n";
+  }
   stream << '\n';
   stream << "}\n";
   stream << '\n';
@@ -824,6 +860,9 @@ Error CppAtlasGenerator::writeHpp() {
   stream << '\n';
   stream << "namespace animera {\n";
   stream << sprite_rect_def;
+  if (trim) {
+    stream << sprite_trim_def;
+  }
   stream << sprite_rect_operators;
   stream << texture_info_def;
   if (withInflate) {
@@ -839,6 +878,9 @@ Error CppAtlasGenerator::writeHpp() {
   stream << "extern const std::size_t texture_size;\n";
   stream << "extern const unsigned char texture_data[];\n";
   stream << "extern const SpriteRect sprite_rects[];\n";
+  if (trim) {
+    stream << "extern const SpriteTrim sprite_trims[];\n";
+  }
   stream << '\n';
   stream << "enum class SpriteID {\n";
   stream << enumeration;
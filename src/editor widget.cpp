@@ -334,8 +334,27 @@ private:
   }
 };
 
+namespace {
+
+// Small rectangles (such as brush strokes) aren't worth the overhead
+void compositeCanvas(
+  QImage &dst,
+  const PaletteCSpan palette,
+  const Frame &frame,
+  const Format format,
+  const QRect rect
+) {
+  if (rect.width() * rect.height() >= edit_parallel_composite) {
+    compositeFrameParallel(dst, palette, frame, format, rect);
+  } else {
+    compositeFrame(dst, palette, frame, format, rect);
+  }
+}
+
+}
+
 EditorWidget::EditorWidget(QWidget *parent)
-  : ScrollAreaWidget{parent} {
+  : ScrollAreaWidget{parent}, frameCache{edit_frame_cache} {
   setFocusPolicy(Qt::NoFocus);
   setFrameShape(NoFrame);
   setAlignment(Qt::AlignCenter);
@@ -364,10 +383,21 @@ void EditorWidget::composite(const QRect rect) {
   #endif
   
   #if DISABLE_PAINT_RECT
-  compositeFrame(view->getTarget(), palette, frame, format, toRect(size));
+  compositeCanvas(view->getTarget(), palette, frame, format, toRect(size));
   view->repaint();
   #else
-  compositeFrame(view->getTarget(), palette, frame, format, rect);
+  // Compositing the whole canvas usually means that the frame has changed.
+  // During playback, every frame will eventually be in the cache.
+  if (rect.contains(toRect(size))) {
+    if (const QImage *cached = frameCache.find(frame)) {
+      view->getTarget() = *cached;
+    } else {
+      compositeCanvas(view->getTarget(), palette, frame, format, toRect(size));
+      frameCache.insert(frame, view->getTarget());
+    }
+  } else if (!layerCache.composite(view->getTarget(), palette, frame, format, rect)) {
+    compositeCanvas(view->getTarget(), palette, frame, format, rect);
+  }
   SET_DEBUG_PAINT(true);
   const int scale = view->getScale();
   view->repaint({rect.topLeft() * scale, rect.size() * scale});
@@ -399,15 +429,24 @@ void EditorWidget::compositePalette() {
   SCOPE_TIME("EditorWidget::compositePalette");
   
   if (format == Format::index) {
+    frameCache.clear();
+    layerCache.clear();
     composite(toRect(size));
   }
 }
 
+void EditorWidget::setCelImage(const CelImage *cel) {
+  layerCache.setCel(cel);
+}
+
 void EditorWidget::setFrame(const Frame &newFrame) {
   frame = newFrame;
+  layerCache.clear();
 }
 
 void EditorWidget::setPalette(const PaletteCSpan newPalette) {
+  frameCache.clear();
+  layerCache.clear();
   palette = newPalette;
 }
 
@@ -416,12 +455,16 @@ void EditorWidget::initCanvas(const Format newFormat, const QSize newSize) {
   
   format = newFormat;
   size = newSize;
+  frameCache.clear();
+  layerCache.clear();
   view->setSize(size);
   Q_EMIT overlayChanged(view->getOverlay());
 }
 
 void EditorWidget::resizeCanvas(const QSize newSize) {
   size = newSize;
+  frameCache.clear();
+  layerCache.clear();
   view->setSize(size);
   composite(toRect(size));
   compositeOverlay(toRect(size));
@@ -11,6 +11,8 @@
 
 #include "tool.hpp"
 #include "cel.hpp"
+#include "layer cache.hpp"
+#include "frame cache.hpp"
 #include "palette span.hpp"
 #include "scroll bar widget.hpp"
 
@@ -21,6 +23,10 @@ class EditorWidget final : public ScrollAreaWidget {
 
 public:
   explicit EditorWidget(QWidget *);
+  
+  /// Set the cel that is being edited so that the layers above and below it
+  /// can be cached
+  void setCelImage(const CelImage *);
 
 Q_SIGNALS:
   void overlayChanged(QImage *);
@@ -43,6 +49,8 @@ public Q_SLOTS:
 
 private:
   EditorImage *view = nullptr;
+  FrameCache frameCache;
+  LayerCache layerCache;
   Frame frame;
   PaletteCSpan palette;
   QSize size;
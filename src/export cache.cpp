@@ -0,0 +1,290 @@
+﻿//
+//  export cache.cpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#include "export cache.hpp"
+
+#include "file io.hpp"
+#include <algorithm>
+#include "scope time.hpp"
+#include <QtCore/qdir.h>
+#include <QtCore/qdatetime.h>
+#include <QtCore/qfileinfo.h>
+#include "animation file.hpp"
+#include "export params.hpp"
+#include <QtCore/qjsonarray.h>
+#include <QtCore/qdatastream.h>
+#include <QtCore/qjsondocument.h>
+#include "export texture atlas.hpp"
+#include <QtCore/qcryptographichash.h>
+
+Error hashFile(QByteArray &hash, const QString &path) {
+  SCOPE_TIME("hashFile");
+  
+  FileReader reader;
+  TRY(reader.open(path));
+  QCryptographicHash hasher{QCryptographicHash::Sha1};
+  if (!hasher.addData(&reader.dev())) {
+    return "Failed to read file\n" + QDir::toNativeSeparators(path);
+  }
+  hash = hasher.result().toHex();
+  return reader.flush();
+}
+
+namespace {
+
+QByteArray hashConfig(const QByteArray &data) {
+  QCryptographicHash hasher{QCryptographicHash::Sha1};
+  hasher.addData(QByteArray::number(expt_cache_version));
+  hasher.addData(data);
+  return hasher.result().toHex();
+}
+
+QJsonArray toArray(const std::vector<QByteArray> &strings) {
+  QJsonArray array;
+  for (const QByteArray &string : strings) {
+    array.append(QString::fromLatin1(string));
+  }
+  return array;
+}
+
+// The size and modification time of a file that was written by an export
+QJsonObject outputInfo(const QFileInfo &info) {
+  QJsonObject object;
+  object.insert("path", info.absoluteFilePath());
+  object.insert("size", info.size());
+  object.insert("modified", info.lastModified().toMSecsSinceEpoch());
+  return object;
+}
+
+Format spriteFormat(const QImage &image) {
+  switch (image.format()) {
+    case qimageFormat(Format::index): return Format::index;
+    case qimageFormat(Format::gray): return Format::gray;
+    default: return Format::rgba;
+  }
+}
+
+void writeState(QDataStream &stream, const SpriteNameState &state) {
+  stream << qint32{+state.layer} << qint32{+state.group} << qint32{+state.frame};
+  stream << qint32{+state.layerCount} << qint32{+state.groupCount} << qint32{+state.frameCount};
+  stream << qint32{+state.maxGroupFrameCount};
+  stream << qint32{+state.groupFrameCount} << qint32{+state.groupBegin};
+  stream << QByteArray{state.layerName.data(), static_cast<int>(state.layerName.size())};
+  stream << QByteArray{state.groupName.data(), static_cast<int>(state.groupName.size())};
+}
+
+// The format is checked because a corrupt cache is treated as a miss
+bool readFormat(QDataStream &stream, Format &format) {
+  qint32 value = -1;
+  stream >> value;
+  if (value < 0 || value > static_cast<qint32>(Format::gray)) return false;
+  format = static_cast<Format>(value);
+  return true;
+}
+
+template <typename Idx>
+void readIdx(QDataStream &stream, Idx &idx) {
+  qint32 value;
+  stream >> value;
+  idx = static_cast<Idx>(value);
+}
+
+void readName(QDataStream &stream, std::deque<std::string> &names, std::string_view &name) {
+  QByteArray bytes;
+  stream >> bytes;
+  name = names.emplace_back(bytes.constData(), static_cast<std::size_t>(bytes.size()));
+}
+
+void readState(QDataStream &stream, std::deque<std::string> &names, SpriteNameState &state) {
+  readIdx(stream, state.layer);
+  readIdx(stream, state.group);
+  readIdx(stream, state.frame);
+  readIdx(stream, state.layerCount);
+  readIdx(stream, state.groupCount);
+  readIdx(stream, state.frameCount);
+  readIdx(stream, state.maxGroupFrameCount);
+  readIdx(stream, state.groupFrameCount);
+  readIdx(stream, state.groupBegin);
+  readName(stream, names, state.layerName);
+  readName(stream, names, state.groupName);
+}
+
+}
+
+ExportCache::ExportCache(const ExportParams &params, const QJsonObject &json) {
+  dir = params.directory + '/' + params.name + ".animera-cache";
+  config = hashConfig(QJsonDocument{json}.toJson(QJsonDocument::Compact));
+  
+  // The sprites of an animation only depend on the file and the parameters of
+  // the animation
+  for (const QJsonValue &anim : json.value("animations").toArray()) {
+    animConfigs.push_back(QJsonDocument{QJsonArray{anim}}.toJson(QJsonDocument::Compact));
+  }
+  
+  QFile file{dir + "/manifest.json"};
+  if (file.open(QIODevice::ReadOnly)) {
+    manifest = QJsonDocument::fromJson(file.readAll()).object();
+  }
+}
+
+void ExportCache::setInputs(std::vector<QByteArray> newInputs) {
+  assert(newInputs.size() == animConfigs.size());
+  inputs = std::move(newInputs);
+  stored.assign(inputs.size(), 0);
+}
+
+bool ExportCache::upToDate() const {
+  if (manifest.value("version").toInt() != expt_cache_version) return false;
+  if (manifest.value("config").toString() != QString::fromLatin1(config)) return false;
+  if (manifest.value("inputs").toArray() != toArray(inputs)) return false;
+  for (const QJsonValue &output : manifest.value("outputs").toArray()) {
+    const QJsonObject object = output.toObject();
+    const QFileInfo info{object.value("path").toString()};
+    if (!info.exists() || object != outputInfo(info)) return false;
+  }
+  return true;
+}
+
+bool ExportCache::readSprites(AtlasAnimation &anim, const std::size_t s, const bool images) {
+  SCOPE_TIME("ExportCache::readSprites");
+  
+  FileReader reader;
+  if (Error err = reader.open(spritePath(spriteKey(s))); err) return false;
+  QDataStream stream{&reader.dev()};
+  
+  qint32 version;
+  quint32 count;
+  stream >> version;
+  if (!readFormat(stream, anim.format)) return false;
+  stream >> anim.size >> count;
+  if (stream.status() != QDataStream::Ok || version != expt_cache_version) return false;
+  if (Error err = readPLTE(reader.dev(), anim.palette, anim.format); err) return false;
+  
+  anim.names.clear();
+  anim.sprites.clear();
+  CelBuffer buffer;
+  for (quint32 i = 0; i != count; ++i) {
+    AtlasSprite &sprite = anim.sprites.emplace_back();
+    readState(stream, anim.names, sprite.state);
+    stream >> sprite.blank;
+    if (stream.status() != QDataStream::Ok) return false;
+    if (sprite.blank) continue;
+    
+    // Every sprite of an animation is rendered at the same size
+    Format spriteFmt;
+    QSize size;
+    if (!readFormat(stream, spriteFmt)) return false;
+    stream >> size;
+    if (stream.status() != QDataStream::Ok || size.isEmpty() || size != anim.size) return false;
+    if (!images) {
+      if (Error err = skipCDAT(reader.dev()); err) return false;
+      continue;
+    }
+    sprite.image = QImage{size, qimageFormat(spriteFmt)};
+    buffer.copied.clear();
+    CelData data{&sprite.image, 0, 0};
+    if (Error err = readCDAT(reader.dev(), data, buffer); err) return false;
+    if (Error err = inflateCDAT(buffer.data(), data, spriteFmt, false); err) return false;
+  }
+  
+  if (reader.flush()) return false;
+  if (images) stored[s] = true;
+  return true;
+}
+
+Error ExportCache::writeSprites(const AtlasAnimation &anim, const std::size_t s) {
+  SCOPE_TIME("ExportCache::writeSprites");
+  
+  if (!QDir{}.mkpath(dir)) {
+    return "Failed to create directory\n" + QDir::toNativeSeparators(dir);
+  }
+  FileWriter writer;
+  TRY(writer.open(spritePath(spriteKey(s))));
+  QDataStream stream{&writer.dev()};
+  
+  stream << qint32{expt_cache_version} << static_cast<qint32>(anim.format) << anim.size;
+  stream << static_cast<quint32>(anim.sprites.size());
+  TRY(writePLTE(writer.dev(), anim.palette, anim.format));
+  
+  // The length of a CDAT chunk isn't known in advance so each one is
+  // compressed into a buffer before being copied into the file
+  QByteArray chunk;
+  for (const AtlasSprite &sprite : anim.sprites) {
+    writeState(stream, sprite.state);
+    stream << sprite.blank;
+    if (sprite.blank) continue;
+    const Format format = spriteFormat(sprite.image);
+    stream << static_cast<qint32>(format) << sprite.image.size();
+    chunk.clear();
+    QBuffer buffer{&chunk};
+    buffer.open(QIODevice::WriteOnly);
+    TRY(writeCDAT(buffer, sprite.image, format, cel_compression_fast));
+    TRY(writeCDAT(writer.dev(), chunk));
+  }
+  
+  if (stream.status() != QDataStream::Ok) {
+    return "Failed to write cache\n" + QDir::toNativeSeparators(dir);
+  }
+  TRY(writer.flush());
+  stored[s] = true;
+  return {};
+}
+
+Error ExportCache::finish(const std::vector<QString> &outputs) const {
+  SCOPE_TIME("ExportCache::finish");
+  
+  std::vector<QByteArray> sprites;
+  for (std::size_t s = 0; s != inputs.size(); ++s) {
+    if (stored[s]) {
+      sprites.push_back(spriteKey(s));
+    } else {
+      QFile::remove(spritePath(spriteKey(s)));
+    }
+  }
+  
+  // Sprites of animations that have changed since the previous export are
+  // not needed anymore
+  for (const QJsonValue &old : manifest.value("sprites").toArray()) {
+    const QByteArray key = old.toString().toLatin1();
+    if (std::find(sprites.begin(), sprites.end(), key) == sprites.end()) {
+      QFile::remove(spritePath(key));
+    }
+  }
+  
+  QJsonObject newManifest;
+  newManifest.insert("version", expt_cache_version);
+  newManifest.insert("config", QString::fromLatin1(config));
+  newManifest.insert("inputs", toArray(inputs));
+  newManifest.insert("sprites", toArray(sprites));
+  
+  QJsonArray outputArray;
+  for (const QString &path : outputs) {
+    outputArray.append(outputInfo(QFileInfo{path}));
+  }
+  newManifest.insert("outputs", outputArray);
+  
+  if (!QDir{}.mkpath(dir)) {
+    return "Failed to create directory\n" + QDir::toNativeSeparators(dir);
+  }
+  FileWriter writer;
+  TRY(writer.open(dir + "/manifest.json"));
+  const QByteArray utf8 = QJsonDocument{newManifest}.toJson();
+  if (writer.dev().write(utf8) != utf8.size()) {
+    return "Error writing export cache manifest\n";
+  }
+  return writer.flush();
+}
+
+QByteArray ExportCache::spriteKey(const std::size_t s) const {
+  assert(s < inputs.size());
+  return hashConfig(inputs[s] + animConfigs[s]);
+}
+
+QString ExportCache::spritePath(const QByteArray &key) const {
+  return dir + '/' + QString::fromLatin1(key) + ".sprites";
+}
@@ -0,0 +1,64 @@
+﻿//
+//  export cache.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_export_cache_hpp
+#define animera_export_cache_hpp
+
+#include "error.hpp"
+#include <QtCore/qjsonobject.h>
+
+struct ExportParams;
+struct AtlasAnimation;
+
+/// Hash the contents of a file
+Error hashFile(QByteArray &, const QString &);
+
+/// The cache of an atlas is a directory next to the atlas. It contains a
+/// manifest that records hashes of the inputs to the previous export, the
+/// size and modification time of each file that it wrote, and the sprites of
+/// each animation that it rendered. An atlas can be skipped if none of its
+/// inputs have changed and its files haven't been touched since. Otherwise,
+/// only the animations that have changed need to be rendered again.
+class ExportCache {
+public:
+  /// The config is the JSON object that the atlas is exported with
+  ExportCache(const ExportParams &, const QJsonObject &);
+  
+  /// Set the hashes of the animation files in the order of the animations
+  void setInputs(std::vector<QByteArray>);
+  /// Determine whether the previous export had the same inputs and the files
+  /// that it wrote are unchanged
+  bool upToDate() const;
+  
+  /// Read the sprites of an animation that were rendered by a previous export.
+  /// The images are skipped if the last parameter is false. Returns false if
+  /// the sprites are not in the cache.
+  bool readSprites(AtlasAnimation &, std::size_t, bool);
+  /// Write the sprites of an animation so that future exports can use them.
+  /// The sprites of different animations can be read and written in parallel.
+  Error writeSprites(const AtlasAnimation &, std::size_t);
+  
+  /// Write the manifest and remove sprites that are no longer used. Only the
+  /// sprites that were read or written successfully are kept. The outputs are
+  /// the paths of the files that were written for the atlas.
+  Error finish(const std::vector<QString> &) const;
+
+private:
+  QString dir;
+  QByteArray config;
+  std::vector<QByteArray> animConfigs;
+  std::vector<QByteArray> inputs;
+  // Not std::vector<bool> so that the elements can be set in parallel
+  std::vector<char> stored;
+  QJsonObject manifest;
+  
+  QByteArray spriteKey(std::size_t) const;
+  QString spritePath(const QByteArray &) const;
+};
+
+#endif
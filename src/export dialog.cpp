@@ -74,6 +74,7 @@ void ExportDialog::submit() {
   params.pixelFormat = formatFromString(formatSelect->currentText());
   params.generator = std::make_unique<PngAtlasGenerator>();
   params.whitepixel = true;
+  params.trim = false;
   
   AnimExportParams &animParams = params.anims.emplace_back();
   
@@ -53,6 +53,7 @@ struct ExportParams {
   std::unique_ptr<AtlasGenerator> generator;
   std::vector<AnimExportParams> anims;
   bool whitepixel;
+  bool trim;
 };
 
 #endif
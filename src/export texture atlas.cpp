@@ -8,6 +8,7 @@
 
 #include "export texture atlas.hpp"
 
+#include "parallel.hpp"
 #include "animation.hpp"
 #include "composite.hpp"
 #include "atlas generator.hpp"
@@ -286,114 +287,135 @@ const QImage *selectImage(Images &images, const AnimExportParams &animParams) {
   }
 }
 
-void addFrameNames(
-  std::size_t &index,
-  const ExportParams &params,
+/// A sprite of an animation that is rendered on the thread pool before it is
+/// moved into an AtlasAnimation
+struct Sprite {
+  SpriteNameState state;
+  /// The cels of the frame or the cel. Empty if the sprite is blank
+  Frame frame;
+  QImage image;
+};
+
+Error addFrameSprites(
+  std::vector<Sprite> &sprites,
   const AnimExportParams &animParams,
   const Animation &anim
 ) {
-  const QSize size = getTransformedSize(anim.getSize(), animParams.transform);
-  NameAppender appender{params.generator.get(), animParams.name, size};
   auto iterate = [&](const Frame &frame, const SpriteNameState &state) {
-    appender.append(index, state, frame.empty());
+    sprites.push_back({state, frame, {}});
   };
-  static_cast<void>(eachFrame(animParams, anim, iterate));
+  return eachFrame(animParams, anim, iterate);
 }
 
-void addCelNames(
-  std::size_t &index,
-  const ExportParams &params,
+Error addCelSprites(
+  std::vector<Sprite> &sprites,
   const AnimExportParams &animParams,
   const Animation &anim
 ) {
-  const QSize size = getTransformedSize(anim.getSize(), animParams.transform);
-  NameAppender appender{params.generator.get(), animParams.name, size};
-  auto iterate = [&](const CelImage *img, const SpriteNameState &state) {
-    appender.append(index, state, img->isNull());
+  auto iterate = [&](const CelImage *cel, const SpriteNameState &state) {
+    Sprite &sprite = sprites.emplace_back();
+    sprite.state = state;
+    if (*cel) sprite.frame.push_back(cel);
   };
-  static_cast<void>(eachCel(animParams, anim, iterate));
+  return eachCel(animParams, anim, iterate);
 }
 
-Error addFrameImages(
-  std::size_t &index,
-  const ExportParams &params,
-  const AnimExportParams &animParams,
-  const Animation &anim
-) {
+void renderSprite(Sprite &sprite, const AnimExportParams &animParams, const Animation &anim) {
+  if (sprite.frame.empty()) return;
   Images images;
   initImages(images, animParams, anim);
-  const Format format = anim.getFormat();
-  const PaletteCSpan palette = anim.palette.getPalette();
-  const QSize size = getTransformedSize(anim.getSize(), animParams.transform);
-  ImageCopier copier{params.generator.get(), animParams.name, size, format};
-  
-  auto iterate = [&](const Frame &frame, const SpriteNameState &state) {
-    if (!frame.empty()) {
-      if (format == Format::gray) {
-        compositeFrame<FmtGray>(images.canvas, palette, frame, format, images.canvas.rect());
-      } else {
-        compositeFrame<FmtRgba>(images.canvas, palette, frame, format, images.canvas.rect());
-      }
-      return copier.copy(index, state, selectImage(images, animParams));
+  if (animParams.composite) {
+    const Format format = anim.getFormat();
+    const PaletteCSpan palette = anim.palette.getPalette();
+    if (format == Format::gray) {
+      compositeFrame<FmtGray>(images.canvas, palette, sprite.frame, format, images.canvas.rect());
     } else {
-      return copier.copy(index, state, nullptr);
+      compositeFrame<FmtRgba>(images.canvas, palette, sprite.frame, format, images.canvas.rect());
     }
-  };
-  
-  return eachFrame(animParams, anim, iterate);
+  } else {
+    const CelImage *cel = sprite.frame.front();
+    clearImage(images.canvas);
+    blitImage(images.canvas, cel->img, cel->pos);
+  }
+  sprite.image = *selectImage(images, animParams);
+}
+
+Error checkFormat(const ExportParams &params, const std::size_t s, const Format format) {
+  const Format compFormat = compositedFormat(format, params.anims[s].composite);
+  if (!params.generator->supported(params.pixelFormat, compFormat)) {
+    return "Format is not supported by atlas generator";
+  }
+  return {};
+}
+
+Error beginAtlas(const ExportParams &params) {
+  AtlasInfo info = {params.name, params.directory, params.pixelFormat, params.trim};
+  if (info.directory.isEmpty()) {
+    info.directory = ".";
+  }
+  return params.generator->beginAtlas(info);
+}
+
+std::size_t spriteBytes(const AtlasAnimation &anim) {
+  const std::size_t bytes = static_cast<std::size_t>(anim.size.width()) * anim.size.height() * 4;
+  return anim.sprites.size() * bytes;
 }
 
-Error addCelImages(
+Error copySprites(
   std::size_t &index,
   const ExportParams &params,
-  const AnimExportParams &animParams,
-  const Animation &anim
+  const std::size_t s,
+  const AtlasAnimation &anim
 ) {
-  Images images;
-  initImages(images, animParams, anim);
-  const QSize size = getTransformedSize(anim.getSize(), animParams.transform);
-  ImageCopier copier{params.generator.get(), animParams.name, size, anim.getFormat()};
+  const Format format = compositedFormat(anim.format, params.anims[s].composite);
+  TRY(params.generator->setImageFormat(format, anim.palette));
+  ImageCopier copier{params.generator.get(), params.anims[s].name, anim.size, anim.format};
+  for (const AtlasSprite &sprite : anim.sprites) {
+    const QImage *image = sprite.blank ? nullptr : &sprite.image;
+    TRY(copier.copy(index, sprite.state, image));
+  }
+  return {};
+}
+
+class AnimationSource final : public AtlasSource {
+public:
+  AnimationSource(const ExportParams &params, const Animation &anim)
+    : params{params}, anim{anim} {}
   
-  auto iterate = [&](const CelImage *cel, const SpriteNameState &state) {
-    if (*cel) {
-      clearImage(images.canvas);
-      blitImage(images.canvas, cel->img, cel->pos);
-      return copier.copy(index, state, selectImage(images, animParams));
-    } else {
-      return copier.copy(index, state, nullptr);
-    }
-  };
+  Error readStates(AtlasAnimation &rendered, const std::size_t s) override {
+    return renderAnimation(rendered, params.anims[s], anim, false);
+  }
   
-  return eachCel(animParams, anim, iterate);
-}
+  Error readSprites(AtlasAnimation &rendered, const std::size_t s) override {
+    return renderAnimation(rendered, params.anims[s], anim, true);
+  }
 
-using AnimPtr = std::unique_ptr<const Animation, void(*)(const Animation *)>;
-using AnimArray = std::vector<AnimPtr>;
+private:
+  const ExportParams &params;
+  const Animation &anim;
+};
+
+}
 
-Error exportTextureAtlas(const ExportParams &params, const AnimArray &anims) {
+Error exportTextureAtlas(const ExportParams &params, AtlasSource &source) {
   assert(params.generator);
-  assert(params.anims.size() == anims.size());
-  assert(!anims.empty());
+  assert(!params.anims.empty());
   
+  std::vector<AtlasAnimation> anims(params.anims.size());
+  std::vector<std::size_t> counts;
   for (std::size_t s = 0; s != anims.size(); ++s) {
-    const Format format = compositedFormat(anims[s]->getFormat(), params.anims[s].composite);
-    if (!params.generator->supported(params.pixelFormat, format)) {
-      return "Format is not supported by atlas generator";
-    }
+    TRY(source.readStates(anims[s], s));
+    TRY(checkFormat(params, s, anims[s].format));
+    counts.push_back(anims[s].sprites.size());
   }
   
-  AtlasInfo info = {params.name, params.directory, params.pixelFormat};
-  if (info.directory.isEmpty()) {
-    info.directory = ".";
-  }
-  TRY(params.generator->beginAtlas(info));
+  TRY(beginAtlas(params));
   
   std::size_t spriteIndex = 0;
   for (std::size_t s = 0; s != anims.size(); ++s) {
-    if (params.anims[s].composite) {
-      addFrameNames(spriteIndex, params, params.anims[s], *anims[s]);
-    } else {
-      addCelNames(spriteIndex, params, params.anims[s], *anims[s]);
+    NameAppender appender{params.generator.get(), params.anims[s].name, anims[s].size};
+    for (const AtlasSprite &sprite : anims[s].sprites) {
+      appender.append(spriteIndex, sprite.state, sprite.blank);
     }
   }
   
@@ -407,15 +429,36 @@ Error exportTextureAtlas(const ExportParams &params, const AnimArray &anims) {
   
   TRY(params.generator->beginImages());
   
+  // The sprites of a batch of animations are rendered in parallel and then
+  // copied in order. The size of a batch is limited to bound the memory used
+  // by the rendered sprites. The sprites of a batch are released before the
+  // next batch is rendered.
   spriteIndex = 0;
-  for (std::size_t s = 0; s != anims.size(); ++s) {
-    const Format format = compositedFormat(anims[s]->getFormat(), params.anims[s].composite);
-    TRY(params.generator->setImageFormat(format, anims[s]->palette.getPalette()));
-    if (params.anims[s].composite) {
-      TRY(addFrameImages(spriteIndex, params, params.anims[s], *anims[s]));
-    } else {
-      TRY(addCelImages(spriteIndex, params, params.anims[s], *anims[s]));
+  std::size_t first = 0;
+  while (first != anims.size()) {
+    std::size_t bytes = 0;
+    std::size_t last = first;
+    while (last != anims.size() && (last == first || bytes < expt_render_budget)) {
+      bytes += spriteBytes(anims[last]);
+      ++last;
     }
+    
+    std::vector<Error> errors(last - first);
+    parallelFor(last - first, [&](const std::size_t i) {
+      errors[i] = source.readSprites(anims[first + i], first + i);
+    });
+    for (Error &err : errors) {
+      if (err) return std::move(err);
+    }
+    
+    for (std::size_t s = first; s != last; ++s) {
+      if (anims[s].sprites.size() != counts[s]) {
+        return "Sprites of animation changed during export";
+      }
+      TRY(copySprites(spriteIndex, params, s, anims[s]));
+      anims[s] = {};
+    }
+    first = last;
   }
   
   if (params.whitepixel) {
@@ -425,35 +468,63 @@ Error exportTextureAtlas(const ExportParams &params, const AnimArray &anims) {
   return params.generator->endAtlas();
 }
 
+Error exportTextureAtlas(const ExportParams &params, const Animation &anim) {
+  AnimationSource source{params, anim};
+  return exportTextureAtlas(params, source);
 }
 
-Error exportTextureAtlas(const ExportParams &params, const std::vector<QString> &paths) {
-  // TODO: This is not very efficient
-  // We only need to load the selected portion of the file
-  // Although the common case is to export the whole thing so
-  // we'd be optimizing an uncommon situation
+Error renderAnimation(
+  AtlasAnimation &rendered,
+  const AnimExportParams &animParams,
+  const Animation &anim,
+  const bool images
+) {
+  std::vector<Sprite> sprites;
+  if (animParams.composite) {
+    TRY(addFrameSprites(sprites, animParams, anim));
+  } else {
+    TRY(addCelSprites(sprites, animParams, anim));
+  }
+  if (images) {
+    parallelFor(sprites.size(), [&](const std::size_t i) {
+      renderSprite(sprites[i], animParams, anim);
+    });
+  }
+  
+  rendered.format = anim.getFormat();
+  rendered.size = getTransformedSize(anim.getSize(), animParams.transform);
+  const PaletteCSpan palette = anim.palette.getPalette();
+  std::copy(palette.begin(), palette.end(), rendered.palette.begin());
+  rendered.names.clear();
+  rendered.sprites.clear();
+  rendered.sprites.reserve(sprites.size());
   
-  // Also, I have to do all this nonsense instead of using std::vector<Animation>
-  // because QObject doesn't have a move constructor. Might be better off using
-  // a simpler data structure here. We don't need the full functionality of
-  // Animation.
-  AnimArray anims;
-  for (const QString &path : paths) {
-    auto *anim = new Animation;
-    if (Error err = anim->openFile(path)) {
-      delete anim;
-      return err;
+  // The names are copied out of the animation. Consecutive sprites usually
+  // have the same names so a name is only copied when it changes.
+  std::string_view layerName;
+  std::string_view groupName;
+  for (Sprite &sprite : sprites) {
+    if (sprite.state.layerName != layerName) {
+      layerName = rendered.names.emplace_back(sprite.state.layerName);
     }
-    anims.push_back(AnimPtr{anim, [](const Animation *anim) {
-      delete anim;
-    }});
+    if (sprite.state.groupName != groupName) {
+      groupName = rendered.names.emplace_back(sprite.state.groupName);
+    }
+    AtlasSprite &atlasSprite = rendered.sprites.emplace_back();
+    atlasSprite.state = sprite.state;
+    atlasSprite.state.layerName = layerName;
+    atlasSprite.state.groupName = groupName;
+    atlasSprite.image = std::move(sprite.image);
+    atlasSprite.blank = sprite.frame.empty();
   }
-  
-  return exportTextureAtlas(params, anims);
+  return {};
 }
 
-Error exportTextureAtlas(const ExportParams &params, const Animation &anim) {
-  AnimArray anims;
-  anims.push_back(AnimPtr{&anim, [](const Animation *) {}});
-  return exportTextureAtlas(params, anims);
+CelRect exportRect(const AnimExportParams &params) {
+  // Only the selected portion of the file is decoded. The ranges are
+  // validated after loading.
+  return {
+    params.layers.min, params.frames.min,
+    params.layers.max, params.frames.max
+  };
 }
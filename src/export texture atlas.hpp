@@ -9,12 +9,55 @@
 #ifndef animera_export_texture_atlas_hpp
 #define animera_export_texture_atlas_hpp
 
+#include <deque>
 #include "error.hpp"
 #include "export params.hpp"
 
 class Animation;
 
-Error exportTextureAtlas(const ExportParams &, const std::vector<QString> &);
+/// A sprite that has been rendered. The image is null if the sprite is blank
+/// or if only the states of the sprites were requested.
+struct AtlasSprite {
+  SpriteNameState state;
+  QImage image;
+  bool blank = false;
+};
+
+/// The rendered sprites of an animation along with everything else that is
+/// needed to add them to an atlas. The names of the sprite states refer to
+/// the strings in names.
+struct AtlasAnimation {
+  Format format;
+  QSize size;
+  PaletteColors palette;
+  std::deque<std::string> names;
+  std::vector<AtlasSprite> sprites;
+};
+
+/// Supplies the sprites of the animations of an atlas. The states of every
+/// animation are read first so that the names can be added to the atlas. The
+/// sprites are then read in batches so that only some of them are in memory
+/// at once.
+class AtlasSource {
+public:
+  virtual ~AtlasSource() = default;
+  
+  /// Get the states of the sprites of an animation without their images
+  virtual Error readStates(AtlasAnimation &, std::size_t) = 0;
+  /// Get the sprites of an animation with their images. The animations of a
+  /// batch are read in parallel.
+  virtual Error readSprites(AtlasAnimation &, std::size_t) = 0;
+};
+
+Error exportTextureAtlas(const ExportParams &, AtlasSource &);
 Error exportTextureAtlas(const ExportParams &, const Animation &);
 
+/// Get the sprites of an animation and render them if the last parameter is
+/// true. The animation is only read so it can be shared between atlases that
+/// are exported in parallel.
+Error renderAnimation(AtlasAnimation &, const AnimExportParams &, const Animation &, bool);
+
+/// Get the cels of an animation file that need to be loaded to export it
+CelRect exportRect(const AnimExportParams &);
+
 #endif
@@ -17,6 +17,10 @@ public:
   explicit FileIOError(const QIODevice &dev)
     : std::runtime_error{dev.errorString().toStdString()},
       error{dev.errorString()} {}
+  
+  explicit FileIOError(const QString &error)
+    : std::runtime_error{error.toStdString()},
+      error{error} {}
 
   QString msg() const {
     return error;
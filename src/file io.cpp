@@ -8,101 +8,140 @@
 
 #include "file io.hpp"
 
+#include <limits>
 #include <QtCore/qdir.h>
 #include "scope time.hpp"
 #include "file io error.hpp"
 
-/*
-Trying to make file writes atomic
-
-qfile::copy transfers permissions so they'd have to be restored
-file rename is atomic and faster than copy
-
-alternative a
-  save dst info
-  remove dst
-  move src to dst
-  restore dst info
-
-alternative b
-  save dst info
-  copy src to dst
-  restore dst info
-
-alternative c
-  src is memory
-  write src to dst
-*/
+// Atomic writes are done with QSaveFile. It writes to a temporary file in the
+// same directory and then renames it over the destination. The permissions of
+// the destination are preserved.
 
 Error FileWriter::open(const QString &newPath) {
-  buff.setData("", 0);
-  buff.open(QIODevice::WriteOnly);
   path = newPath;
+  equal = 0;
+  changed = false;
+  existing.setFileName(path);
+  if (!existing.open(QIODevice::ReadOnly)) TRY(change());
+  stream.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
   return {};
 }
 
 QIODevice &FileWriter::dev() {
-  return buff;
+  return stream;
 }
 
 Error FileWriter::flush() {
   SCOPE_TIME("FileWriter::flush");
   
-  // TODO: should we try to avoid opening the file twice?
-  buff.close();
-  const qint64 equal = filesEqual();
-  return equal == buff.size() ? Error{} : flushFrom(equal);
+  stream.close();
+  if (!changed) {
+    // The existing file might be longer than what was written
+    if (existing.size() == equal) {
+      existing.close();
+      return {};
+    }
+    TRY(change());
+  }
+  if (!temp.commit()) {
+    return temp.errorString() + "\n" + QDir::toNativeSeparators(path);
+  }
+  return {};
 }
 
-qint64 FileWriter::filesEqual() const {
-  SCOPE_TIME("FileWriter::filesEqual");
- 
-  QFile file{path};
-  if (!file.exists()) return 0;
-  if (file.size() != buff.size()) return 0;
+bool FileWriter::compare(const char *data, qint64 size) {
+  SCOPE_TIME("FileWriter::compare");
   
-  if (!file.open(QIODevice::ReadOnly)) return 0;
   char fileBuffer[compare_buff_size];
-  qint64 equal = 0;
+  while (size > 0) {
+    const qint64 chunkSize = std::min(size, qint64{compare_buff_size});
+    if (existing.read(fileBuffer, chunkSize) != chunkSize) return false;
+    if (std::memcmp(fileBuffer, data, chunkSize) != 0) return false;
+    data += chunkSize;
+    size -= chunkSize;
+  }
+  return true;
+}
+
+Error FileWriter::change() {
+  SCOPE_TIME("FileWriter::change");
   
-  while (!file.atEnd()) {
-    const qint64 read = file.read(fileBuffer, sizeof(fileBuffer));
-    if (read == -1) {
-      return equal;
-    }
-    if (std::memcmp(fileBuffer, buff.data().data() + equal, read) != 0) {
-      return equal;
+  // The part of the existing file that was equal to the written data is
+  // copied into the new file
+  changed = true;
+  temp.setFileName(path);
+  if (!temp.open(QIODevice::WriteOnly)) {
+    return temp.errorString() + "\n" + QDir::toNativeSeparators(path);
+  }
+  if (equal != 0) {
+    if (!existing.seek(0)) return existing.errorString();
+    char fileBuffer[compare_buff_size];
+    qint64 remaining = equal;
+    while (remaining > 0) {
+      const qint64 chunkSize = std::min(remaining, qint64{compare_buff_size});
+      if (existing.read(fileBuffer, chunkSize) != chunkSize) {
+        return existing.errorString();
+      }
+      if (temp.write(fileBuffer, chunkSize) != chunkSize) {
+        return temp.errorString();
+      }
+      remaining -= chunkSize;
     }
-    equal += read;
   }
-  
-  return equal;
+  // The existing file must be closed before it can be replaced on Windows
+  existing.close();
+  return {};
 }
 
-Error FileWriter::flushFrom(const qint64 start) const {
-  SCOPE_TIME("FileWriter::flushFrom");
-  
-  QFile file{path};
-  QIODevice::OpenMode openMode = QIODevice::WriteOnly;
-  if (start != 0) openMode |= QIODevice::ReadOnly;
-  if (!file.open(openMode)) {
-    return file.errorString() + "\n" + QDir::toNativeSeparators(path);
+FileWriter::Stream::Stream(FileWriter &writer)
+  : writer{writer} {}
+
+bool FileWriter::Stream::open(const OpenMode mode) {
+  written = 0;
+  return QIODevice::open(mode);
+}
+
+// QIODevice doesn't track the position of sequential devices but the
+// position is still needed to build the index chunk
+
+bool FileWriter::Stream::isSequential() const {
+  return true;
+}
+
+qint64 FileWriter::Stream::pos() const {
+  return written;
+}
+
+bool FileWriter::Stream::seek(const qint64 newPos) {
+  if (newPos != written) {
+    setErrorString("Cannot seek while writing a file");
+    return false;
   }
-  
-  if (start != 0 && !file.seek(start)) {
-    return file.errorString();
+  return true;
+}
+
+qint64 FileWriter::Stream::readData(char *, qint64) {
+  return -1;
+}
+
+qint64 FileWriter::Stream::writeData(const char *data, const qint64 size) {
+  if (!writer.changed) {
+    if (writer.compare(data, size)) {
+      writer.equal += size;
+      written += size;
+      return size;
+    }
+    if (Error err = writer.change()) {
+      setErrorString(err.msg());
+      return -1;
+    }
   }
-  
-  const char *data = buff.data().data() + start;
-  const qint64 size = buff.data().size() - start;
-  const qint64 written = file.write(data, size);
-  if (written != size) {
-    QString err = file.errorString();
-    if (written > 0) file.remove();
-    return std::move(err);
+  const qint64 tempWritten = writer.temp.write(data, size);
+  if (tempWritten != size) {
+    setErrorString(writer.temp.errorString());
   }
-  
-  return {};
+  if (tempWritten > 0) written += tempWritten;
+  return tempWritten;
 }
 
 Error FileReader::open(const QString &newPath) {
@@ -113,11 +152,35 @@ Error FileReader::open(const QString &newPath) {
   return {};
 }
 
+Error FileReader::openMapped(const QString &newPath) {
+  TRY(open(newPath));
+  
+  // QByteArray can't be larger than 2 GiB. Larger files are read normally.
+  const qint64 size = file.size();
+  if (size <= 0 || size > std::numeric_limits<int>::max()) return {};
+  mapped = file.map(0, size);
+  if (!mapped) return {};
+  
+  buff.setData(QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), static_cast<int>(size)));
+  buff.open(QIODevice::ReadOnly);
+  return {};
+}
+
 QIODevice &FileReader::dev() {
-  return file;
+  if (mapped) {
+    return buff;
+  } else {
+    return file;
+  }
 }
 
 Error FileReader::flush() {
+  if (mapped) {
+    buff.close();
+    buff.setData(QByteArray{});
+    file.unmap(mapped);
+    mapped = nullptr;
+  }
   file.close();
   return {};
 }
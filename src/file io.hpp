@@ -12,7 +12,12 @@
 #include "error.hpp"
 #include <QtCore/qfile.h>
 #include <QtCore/qbuffer.h>
+#include <QtCore/qsavefile.h>
 
+/// Streams to a temporary file that atomically replaces the destination when
+/// flushed. The data is compared with the existing file as it is written and
+/// nothing is written to disk if the file would not change. The device is
+/// sequential so chunks must be written with a known length.
 class FileWriter {
 public:
   static constexpr std::size_t compare_buff_size = 4 * 1024;
@@ -22,21 +27,48 @@ public:
   Error flush();
   
 private:
-  QBuffer buff;
+  class Stream final : public QIODevice {
+  public:
+    explicit Stream(FileWriter &);
+    
+    bool open(OpenMode) override;
+    bool isSequential() const override;
+    qint64 pos() const override;
+    bool seek(qint64) override;
+    
+  protected:
+    qint64 readData(char *, qint64) override;
+    qint64 writeData(const char *, qint64) override;
+    
+  private:
+    FileWriter &writer;
+    qint64 written = 0;
+  };
+
+  Stream stream{*this};
+  QFile existing;
+  QSaveFile temp;
   QString path;
+  qint64 equal = 0;
+  bool changed = false;
   
-  qint64 filesEqual() const;
-  Error flushFrom(qint64) const;
+  bool compare(const char *, qint64);
+  Error change();
 };
 
 class FileReader {
 public:
   Error open(const QString &);
+  /// Map the file into memory if possible. The device is then a read-only
+  /// buffer that ChunkReader reads from directly.
+  Error openMapped(const QString &);
   QIODevice &dev();
   Error flush();
 
 private:
   QFile file;
+  QBuffer buff;
+  uchar *mapped = nullptr;
 };
 
 #endif
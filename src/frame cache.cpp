@@ -0,0 +1,74 @@
+﻿//
+//  frame cache.cpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#include "frame cache.hpp"
+
+#include <QtCore/qhash.h>
+
+FrameCache::FrameCache(const std::size_t budget)
+  : budget{budget} {}
+
+const QImage *FrameCache::find(const Frame &frame) {
+  const auto iter = lookup.find(makeKey(frame));
+  if (iter == lookup.end()) return nullptr;
+  entries.splice(entries.begin(), entries, iter->second);
+  return &iter->second->image;
+}
+
+void FrameCache::insert(const Frame &frame, const QImage &image) {
+  const std::size_t imageSize = image.sizeInBytes();
+  if (imageSize > budget) return;
+  Key key = makeKey(frame);
+  if (const auto iter = lookup.find(key); iter != lookup.end()) {
+    size -= iter->second->image.sizeInBytes();
+    entries.erase(iter->second);
+    lookup.erase(iter);
+  }
+  size += imageSize;
+  evict();
+  entries.push_front({key, image});
+  lookup.emplace(std::move(key), entries.begin());
+}
+
+void FrameCache::clear() {
+  lookup.clear();
+  entries.clear();
+  size = 0;
+}
+
+bool FrameCache::CelKey::operator==(const CelKey &other) const {
+  return cel == other.cel && image == other.image && pos == other.pos;
+}
+
+std::size_t FrameCache::KeyHash::operator()(const Key &key) const {
+  uint hash = 0;
+  for (const CelKey &cel : key) {
+    hash = qHash(cel.cel, hash);
+    hash = qHash(cel.image, hash);
+    hash = qHash(cel.pos.x(), qHash(cel.pos.y(), hash));
+  }
+  return hash;
+}
+
+FrameCache::Key FrameCache::makeKey(const Frame &frame) {
+  Key key;
+  key.reserve(frame.size());
+  for (const CelImage *cel : frame) {
+    key.push_back({cel, cel->img.cacheKey(), cel->pos});
+  }
+  return key;
+}
+
+void FrameCache::evict() {
+  while (size > budget) {
+    const Entry &last = entries.back();
+    size -= last.image.sizeInBytes();
+    lookup.erase(last.key);
+    entries.pop_back();
+  }
+}
@@ -0,0 +1,61 @@
+﻿//
+//  frame cache.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_frame_cache_hpp
+#define animera_frame_cache_hpp
+
+#include <list>
+#include "cel.hpp"
+#include <unordered_map>
+
+/// A least-recently-used cache of composited frames. A frame is identified by
+/// its cels along with the cache key and position of each cel image. QImage
+/// changes its cache key whenever it might be modified so a frame is never
+/// found after one of its cels has been modified.
+class FrameCache {
+public:
+  /// The total size of the cached images is kept below the budget in bytes
+  explicit FrameCache(std::size_t);
+  
+  const QImage *find(const Frame &);
+  void insert(const Frame &, const QImage &);
+  void clear();
+
+private:
+  struct CelKey {
+    const CelImage *cel;
+    qint64 image;
+    QPoint pos;
+    
+    bool operator==(const CelKey &) const;
+  };
+  
+  using Key = std::vector<CelKey>;
+  
+  struct KeyHash {
+    std::size_t operator()(const Key &) const;
+  };
+  
+  struct Entry {
+    Key key;
+    QImage image;
+  };
+  
+  using Iterator = std::list<Entry>::iterator;
+  
+  // Most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<Key, Iterator, KeyHash> lookup;
+  std::size_t size = 0;
+  std::size_t budget;
+  
+  static Key makeKey(const Frame &);
+  void evict();
+};
+
+#endif
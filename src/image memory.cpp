@@ -0,0 +1,32 @@
+﻿//
+//  image memory.cpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#include "image memory.hpp"
+
+void ImageMemory::add(const QImage &image) {
+  if (image.isNull()) return;
+  const auto size = static_cast<std::size_t>(image.sizeInBytes());
+  logicalSize += size;
+  // The const overload doesn't detach
+  if (buffers.insert(image.constBits()).second) {
+    actualSize += size;
+  }
+}
+
+void ImageMemory::addBytes(const std::size_t size) {
+  logicalSize += size;
+  actualSize += size;
+}
+
+std::size_t ImageMemory::logical() const {
+  return logicalSize;
+}
+
+std::size_t ImageMemory::actual() const {
+  return actualSize;
+}
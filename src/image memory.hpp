@@ -0,0 +1,35 @@
+﻿//
+//  image memory.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_image_memory_hpp
+#define animera_image_memory_hpp
+
+#include <unordered_set>
+#include <QtGui/qimage.h>
+
+/// Adds up the memory used by a collection of images. QImage shares pixels
+/// between copies until one of them is modified so images that share pixels
+/// are only counted once.
+class ImageMemory {
+public:
+  void add(const QImage &);
+  /// Add memory that is not shared with anything else
+  void addBytes(std::size_t);
+  
+  /// The number of bytes that would be used if no pixels were shared
+  std::size_t logical() const;
+  /// The number of bytes actually used
+  std::size_t actual() const;
+
+private:
+  std::unordered_set<const uchar *> buffers;
+  std::size_t logicalSize = 0;
+  std::size_t actualSize = 0;
+};
+
+#endif
@@ -8,6 +8,7 @@
 
 #include "image.hpp"
 
+#include <QtCore/qhash.h>
 #include <Graphics/fill.hpp>
 #include "surface factory.hpp"
 #include "graphics convert.hpp"
@@ -30,6 +31,36 @@ void clearImage(QImage &dst, const QRect rect) {
 
 namespace {
 
+std::size_t rowSize(const QImage &img) {
+  return static_cast<std::size_t>(img.width()) * img.depth() / 8;
+}
+
+}
+
+// The padding at the end of each scanline is not part of the image so each
+// scanline is hashed and compared separately
+
+uint hashImage(const QImage &img) {
+  uint hash = qHash(img.width(), qHash(img.height()));
+  for (int y = 0; y != img.height(); ++y) {
+    hash = qHashBits(img.constScanLine(y), rowSize(img), hash);
+  }
+  return hash;
+}
+
+bool sameImage(const QImage &a, const QImage &b) {
+  if (a.size() != b.size()) return false;
+  if (a.cacheKey() == b.cacheKey()) return true;
+  for (int y = 0; y != a.height(); ++y) {
+    if (std::memcmp(a.constScanLine(y), b.constScanLine(y), rowSize(a)) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+namespace {
+
 int index(const QImage &img, const QPoint pos) {
   return pos.y() * img.bytesPerLine() + pos.x() * img.depth() / 8;
 }
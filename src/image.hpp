@@ -91,6 +91,12 @@ void copyImage(QImage &, const QImage &);
 void clearImage(QImage &);
 void clearImage(QImage &, QRect);
 
+/// Hash the pixels of an image. The padding at the end of each scanline is
+/// ignored.
+uint hashImage(const QImage &);
+/// Compare the size and pixels of two images with the same format
+bool sameImage(const QImage &, const QImage &);
+
 // TODO: Is a custom image worth considering?
 // The non-const version is kind of annoying to use.
 // I'm afraid of unnecessary copies happening in the background using either one
@@ -17,6 +17,7 @@ JsonAtlasGenerator::JsonAtlasGenerator()
 Error JsonAtlasGenerator::beginAtlas(const AtlasInfo &info) {
   TRY(BasicAtlasGenerator::beginAtlas(info));
   atlas = "{\"names\":{\"null_\":0";
+  trims.clear();
   atlasName = info.name;
   atlasDir = info.directory;
   return {};
@@ -29,6 +30,11 @@ Error JsonAtlasGenerator::beginImages() {
 }
 
 Error JsonAtlasGenerator::endAtlas() {
+  TRY(endImages());
+  if (trim) {
+    atlas += "],\"trims\":[[0,0,0,0]";
+    atlas += trims;
+  }
   atlas += "],\"width\":";
   atlas += QString::number(packer.width());
   atlas += ",\"height\":";
@@ -51,6 +57,10 @@ Error JsonAtlasGenerator::endAtlas() {
   return {};
 }
 
+std::vector<QString> JsonAtlasGenerator::outputs() const {
+  return {atlasDir + '/' + atlasName + ".json", atlasDir + '/' + atlasName + ".png"};
+}
+
 void JsonAtlasGenerator::appendName(const QString &name, const std::size_t i) {
   atlas += ",\"";
   atlas += name;
@@ -74,6 +84,18 @@ void JsonAtlasGenerator::appendRect(const QRect r) {
   }
 }
 
+void JsonAtlasGenerator::appendTrim(const QPoint offset, const QSize size) {
+  trims += ",[";
+  trims += QString::number(offset.x());
+  trims += ',';
+  trims += QString::number(offset.y());
+  trims += ',';
+  trims += QString::number(size.width());
+  trims += ',';
+  trims += QString::number(size.height());
+  trims += ']';
+}
+
 void JsonAtlasGenerator::fixName(QString &name, std::array<int, 4> &positions) {
   for (int i = 0; i != name.size(); ++i) {
     if (name[i] == '\\') {
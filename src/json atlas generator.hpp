@@ -19,14 +19,17 @@ public:
   Error beginAtlas(const AtlasInfo &) override;
   Error beginImages() override;
   Error endAtlas() override;
+  std::vector<QString> outputs() const override;
   
   void appendName(const QString &, std::size_t) override;
   void appendRect(QRect) override;
+  void appendTrim(QPoint, QSize) override;
   void fixName(QString &, std::array<int, 4> &) override;
   void appendAlias(QString, const char *, std::size_t) override;
 
 private:
   QString atlas;
+  QString trims;
   QString atlasName;
   QString atlasDir;
 };
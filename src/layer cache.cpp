@@ -0,0 +1,150 @@
+﻿//
+//  layer cache.cpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#include "layer cache.hpp"
+
+#include <algorithm>
+#include "composite.hpp"
+#include "config geometry.hpp"
+
+void LayerCache::setCel(const CelImage *newCel) {
+  if (cel != newCel) {
+    clear();
+    cel = newCel;
+  }
+}
+
+void LayerCache::clear() {
+  below = {};
+  above = {};
+  aboveCover.clear();
+}
+
+bool LayerCache::composite(
+  QImage &dst,
+  const PaletteCSpan palette,
+  const Frame &frame,
+  const Format format,
+  QRect rect
+) {
+  const auto iter = std::find(frame.begin(), frame.end(), cel);
+  if (iter == frame.end()) return false;
+  rect = rect.intersected(dst.rect());
+  if (rect.isEmpty()) return true;
+  
+  // Layer 0 is on top of layer 1
+  update(below, dst.size(), palette, Frame{iter + 1, frame.end()}, format);
+  
+  if (below.image.isNull()) {
+    clearImage(dst, rect);
+  } else {
+    QImage region = view(dst, rect);
+    blitImage(region, cview(below.image, rect), {});
+  }
+  compositeOver(dst, palette, *cel, format, rect);
+  
+  const Frame aboveFrame{frame.begin(), iter};
+  if (update(above, dst.size(), palette, aboveFrame, format)) {
+    updateCover(palette, aboveFrame, format);
+  }
+  compositeAbove(dst, palette, aboveFrame, format, rect);
+  return true;
+}
+
+// The tiles are on the same grid as compositeFrame. Within a tile where one of
+// the layers above is opaque, compositeFrame ignores everything underneath
+// that layer so the flattened image is exactly what it would produce. A
+// transparent pixel isn't skipped by the blend (it turns a transparent
+// destination into transparent black) so only tiles that none of the layers
+// above touch are skipped.
+
+void LayerCache::updateCover(
+  const PaletteCSpan palette,
+  const Frame &frame,
+  const Format format
+) {
+  aboveCover.clear();
+  if (above.image.isNull()) return;
+  constexpr int size = glob_composite_tile;
+  const QRect imageRect = above.image.rect();
+  aboveColumns = (imageRect.width() + size - 1) / size;
+  for (int y = 0; y < imageRect.height(); y += size) {
+    for (int x = 0; x < imageRect.width(); x += size) {
+      const QRect tile = QRect{x, y, size, size}.intersected(imageRect);
+      const bool empty = std::none_of(frame.begin(), frame.end(), [tile](const CelImage *c) {
+        return c->rect().intersects(tile);
+      });
+      if (empty) {
+        aboveCover.push_back(Cover::empty);
+      } else if (opaqueCover(frame, palette, format, tile)) {
+        aboveCover.push_back(Cover::opaque);
+      } else {
+        aboveCover.push_back(Cover::partial);
+      }
+    }
+  }
+}
+
+void LayerCache::compositeAbove(
+  QImage &dst,
+  const PaletteCSpan palette,
+  const Frame &frame,
+  const Format format,
+  const QRect rect
+) const {
+  if (above.image.isNull()) return;
+  constexpr int size = glob_composite_tile;
+  const int left = rect.left() - rect.left() % size;
+  const int top = rect.top() - rect.top() % size;
+  for (int y = top; y <= rect.bottom(); y += size) {
+    for (int x = left; x <= rect.right(); x += size) {
+      const QRect tile = QRect{x, y, size, size}.intersected(rect);
+      switch (aboveCover[(y / size) * aboveColumns + x / size]) {
+        case Cover::empty:
+          break;
+        case Cover::opaque: {
+          QImage region = view(dst, tile);
+          blitImage(region, cview(above.image, tile), {});
+          break;
+        }
+        case Cover::partial:
+          // Layer 0 is on top of layer 1
+          for (auto c = frame.rbegin(); c != frame.rend(); ++c) {
+            compositeOver(dst, palette, **c, format, tile);
+          }
+          break;
+      }
+    }
+  }
+}
+
+bool LayerCache::update(
+  Layers &layers,
+  const QSize size,
+  const PaletteCSpan palette,
+  const Frame &frame,
+  const Format format
+) {
+  Key key;
+  key.reserve(frame.size());
+  for (const CelImage *cel : frame) {
+    key.push_back({cel, cel->img.cacheKey(), cel->pos});
+  }
+  if (key == layers.key && layers.image.size() == size) return false;
+  
+  layers.key = std::move(key);
+  if (frame.empty()) {
+    layers.image = {};
+  } else {
+    if (layers.image.size() != size) {
+      layers.image = {size, qimageFormat(Format::rgba)};
+    }
+    compositeFrameParallel(layers.image, palette, frame, format, layers.image.rect());
+  }
+  return true;
+}
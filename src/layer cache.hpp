@@ -0,0 +1,70 @@
+﻿//
+//  layer cache.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_layer_cache_hpp
+#define animera_layer_cache_hpp
+
+#include "cel.hpp"
+#include "palette span.hpp"
+
+/// The visible layers above and below the current layer, each flattened into
+/// a single image. Painting on the current cel then only requires three blends
+/// in most of the canvas regardless of how many layers there are. Like
+/// FrameCache, the other cels are identified by their cache key and position
+/// so the flattened images are rebuilt whenever one of them is modified.
+///
+/// Blending the flattened layers above is not the same as blending each of
+/// them in turn with straight alpha. The flattened image is only used in the
+/// tiles where that doesn't matter. In tiles that none of the layers above
+/// touch, nothing is blended. In tiles where one of them is opaque, the
+/// flattened image is copied. The other tiles blend each layer above in turn.
+class LayerCache {
+public:
+  /// Set the cel that is being edited
+  void setCel(const CelImage *);
+  void clear();
+  
+  /// Composite the frame into the rectangle of the RGBA image. Returns false if
+  /// the current cel is not in the frame
+  bool composite(QImage &, PaletteCSpan, const Frame &, Format, QRect);
+
+private:
+  struct CelKey {
+    const CelImage *cel;
+    qint64 image;
+    QPoint pos;
+    
+    bool operator==(const CelKey &) const = default;
+  };
+  
+  using Key = std::vector<CelKey>;
+  
+  struct Layers {
+    Key key;
+    QImage image;
+  };
+  
+  enum class Cover {
+    empty,
+    opaque,
+    partial
+  };
+  
+  const CelImage *cel = nullptr;
+  Layers below;
+  Layers above;
+  // The cover of the layers above in each tile of the composite tile grid
+  std::vector<Cover> aboveCover;
+  int aboveColumns = 0;
+  
+  static bool update(Layers &, QSize, PaletteCSpan, const Frame &, Format);
+  void updateCover(PaletteCSpan, const Frame &, Format);
+  void compositeAbove(QImage &, PaletteCSpan, const Frame &, Format, QRect) const;
+};
+
+#endif
@@ -2059,7 +2059,202 @@ void blitImageOld(QImage &dst, const QImage &src, const QPoint pos) {
   painter.drawImage(pos, src);
 }
 
+#include "animation.hpp"
+#include <QtCore/qfileinfo.h>
+
+void benchmarkCelCompression(const QString &path) {
+  Animation source;
+  if (Error err = source.openFile(path); err) {
+    std::cout << err.msg().toStdString() << '\n';
+    return;
+  }
+  
+  const std::pair<const char *, CelCompression> presets[] = {
+    {"normal", cel_compression_normal},
+    {"fast", cel_compression_fast},
+    {"archive", cel_compression_archive}
+  };
+  
+  Timer timer;
+  for (const auto &[name, compression] : presets) {
+    const QString output = path + "." + name + ".animera";
+    std::cout << name << '\n';
+    
+    timer.start("Save");
+    Error err = source.saveFile(output, compression);
+    timer.stop();
+    if (err) {
+      std::cout << err.msg().toStdString() << '\n';
+      return;
+    }
+    
+    Animation loaded;
+    timer.start("Load");
+    err = loaded.openFile(output);
+    timer.stop();
+    if (err) {
+      std::cout << err.msg().toStdString() << '\n';
+      return;
+    }
+    
+    std::cout << "Size             " << QFileInfo{output}.size() << " bytes\n\n";
+  }
+}
+
+#include <random>
+#include "composite kernels.hpp"
+
+template <typename Fmt>
+void benchmarkCompositeKernel(void (*kernel)(typename Fmt::Pixel *, const typename Fmt::Pixel *, std::size_t, SimdLevel)) {
+  constexpr int size = 1024;
+  const QImage::Format format = qimageFormat<typename Fmt::Pixel>();
+  QImage src{size, size, format};
+  QImage dst{size, size, format};
+  std::mt19937 gen;
+  for (QImage *image : {&src, &dst}) {
+    std::generate_n(image->bits(), image->sizeInBytes(), std::ref(gen));
+  }
+  
+  Timer timer;
+  QImage expected = dst;
+  timer.start("gfx");
+  gfx::porterDuffRegion(
+    gfx::mode_src_over,
+    makeSurface<typename Fmt::Pixel>(expected),
+    makeCSurface<typename Fmt::Pixel>(src),
+    Fmt{},
+    Fmt{},
+    gfx::Point{0, 0}
+  );
+  timer.stop();
+  
+  const std::pair<const char *, SimdLevel> levels[] = {
+    {"scalar", SimdLevel::scalar},
+    {"sse2", SimdLevel::sse2},
+    {"avx2", SimdLevel::avx2}
+  };
+  for (const auto &[name, level] : levels) {
+    if (maxSimdLevel() < level) break;
+    QImage actual = dst;
+    actual.detach();
+    timer.start(name);
+    for (int y = 0; y != size; ++y) {
+      kernel(
+        reinterpret_cast<typename Fmt::Pixel *>(actual.scanLine(y)),
+        reinterpret_cast<const typename Fmt::Pixel *>(src.constScanLine(y)),
+        size,
+        level
+      );
+    }
+    timer.stop();
+    if (actual != expected) {
+      std::cout << name << " does not match gfx::porterDuff\n";
+    }
+  }
+}
+
+#include "cel array.hpp"
+
+// A 10k frame layer made of short cels like a lip-sync or effects layer
+void benchmarkCelArray() {
+  constexpr int frames = 10000;
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dist{1, 3};
+  std::vector<Cel> cels;
+  for (int f = 0; f < frames;) {
+    const int len = std::min(dist(gen), frames - f);
+    cels.push_back({std::make_unique<CelImage>(), FrameIdx{len}});
+    f += len;
+  }
+  indexCelArray(cels);
+  std::printf("%zu cels\n", cels.size());
+  
+  Timer timer;
+  std::size_t sum = 0;
+  timer.start("getImage");
+  for (FrameIdx f{}; f != FrameIdx{frames}; ++f) {
+    sum += reinterpret_cast<std::uintptr_t>(getImage(tcb::span<const Cel>{cels}, f));
+  }
+  timer.stop();
+  
+  CelCursor cursor;
+  timer.start("getImage cursor");
+  for (FrameIdx f{}; f != FrameIdx{frames}; ++f) {
+    sum += reinterpret_cast<std::uintptr_t>(getImage(cels, cursor, f));
+  }
+  timer.stop();
+  
+  timer.start("insertCelFrame");
+  for (int i = 0; i != 1000; ++i) {
+    insertCelFrame(cels, FrameIdx{i * 7});
+  }
+  timer.stop();
+  
+  timer.start("removeCelFrame");
+  for (int i = 0; i != 1000; ++i) {
+    removeCelFrame(cels, FrameIdx{i * 7});
+  }
+  timer.stop();
+  
+  timer.start("extractCelArray");
+  for (int i = 0; i != 1000; ++i) {
+    sum += extractCelArray(cels, FrameIdx{i * 7}, FrameIdx{16}).size();
+  }
+  timer.stop();
+  
+  std::printf("%zu\n", sum);
+}
+
+#include "image memory.hpp"
+
+void printCelMemory(const char *name, const std::vector<std::vector<Cel>> &arrays) {
+  ImageMemory memory;
+  for (const std::vector<Cel> &cels : arrays) {
+    for (const Cel &cel : cels) {
+      memory.add(cel.cel->img);
+    }
+  }
+  std::printf(
+    "%-16s logical %zu KB actual %zu KB\n",
+    name,
+    memory.logical() / 1024,
+    memory.actual() / 1024
+  );
+}
+
+// Split a linked cel into 256 cels, copy them and then modify one
+void benchmarkCelMemory() {
+  constexpr FrameIdx frames{256};
+  std::vector<std::vector<Cel>> arrays(1);
+  std::vector<Cel> &cels = arrays[0];
+  clearCelArray(cels, frames);
+  replaceCelFrame(cels, FrameIdx{0}, true);
+  CelImage *cel = getImage(cels, FrameIdx{0});
+  cel->img = {256, 256, qimageFormat(Format::rgba)};
+  cel->img.fill(0xFF0000FF);
+  for (FrameIdx f{1}; f != frames; ++f) {
+    extendCel(cels, FrameIdx{0});
+  }
+  printCelMemory("linked", arrays);
+  
+  for (FrameIdx f = frames - FrameIdx{1}; f != FrameIdx{0}; --f) {
+    splitCel(cels, f);
+  }
+  printCelMemory("split", arrays);
+  
+  arrays.push_back(extractCelArray(cels, FrameIdx{0}, frames));
+  printCelMemory("copied", arrays);
+  
+  getImage(arrays[0], FrameIdx{0})->img.fill(0xFF00FF00);
+  printCelMemory("modified", arrays);
+}
+
 int main(int argc, char **argv) {
+  benchmarkCelCompression("/Users/indikernick/Desktop/Test/benchmark.animera");
+  benchmarkCompositeKernel<FmtRgba>(compositeRowRgba);
+  benchmarkCompositeKernel<FmtGray>(compositeRowGray);
+  benchmarkCelArray();
+  benchmarkCelMemory();
 
   /*Image img;
   img.data.load("/Users/indikernick/Library/Developer/Xcode/DerivedData/Pixel_2-gqoblrlhvynmicgniivandqktune/Build/Products/Debug/Pixel 2.app/Contents/Resources/icon.png");
@@ -152,6 +152,11 @@ Error Palette::open(const QString &path) {
   return reader.flush();
 }
 
+void Palette::snapshot(Palette &copy) const {
+  copy.colors = colors;
+  copy.canvasFormat = canvasFormat;
+}
+
 PaletteSpan Palette::getPalette() {
   return {colors.data(), pal_colors};
 }
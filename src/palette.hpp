@@ -24,6 +24,8 @@ public:
   Error deserialize(QIODevice &);
   Error save(const QString &) const;
   Error open(const QString &);
+  /// Copy the parts of the palette that are saved
+  void snapshot(Palette &) const;
 
   PaletteSpan getPalette();
   PaletteCSpan getPalette() const;
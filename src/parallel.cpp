@@ -0,0 +1,81 @@
+﻿//
+//  parallel.cpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#include "parallel.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <QtCore/qrunnable.h>
+#include <QtCore/qsemaphore.h>
+#include <QtCore/qthreadpool.h>
+
+namespace {
+
+struct ParallelState {
+  const std::function<void(std::size_t)> &func;
+  const std::size_t count;
+  std::atomic<std::size_t> next{0};
+  
+  void run() {
+    std::size_t index;
+    while ((index = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+      func(index);
+    }
+  }
+};
+
+class ParallelWorker final : public QRunnable {
+public:
+  ParallelWorker(ParallelState &state, QSemaphore &done)
+    : state{state}, done{done} {
+    setAutoDelete(false);
+  }
+  
+  void run() override {
+    state.run();
+    done.release();
+  }
+
+private:
+  ParallelState &state;
+  QSemaphore &done;
+};
+
+}
+
+void parallelFor(const std::size_t count, const std::function<void(std::size_t)> &func) {
+  if (count == 0) return;
+  
+  QThreadPool *pool = QThreadPool::globalInstance();
+  const auto threads = static_cast<std::size_t>(std::max(pool->maxThreadCount(), 1));
+  const std::size_t workerCount = std::min(count, threads) - 1;
+  if (workerCount == 0) {
+    for (std::size_t i = 0; i != count; ++i) func(i);
+    return;
+  }
+  
+  ParallelState state{func, count};
+  QSemaphore done;
+  std::vector<std::unique_ptr<ParallelWorker>> workers;
+  workers.reserve(workerCount);
+  for (std::size_t w = 0; w != workerCount; ++w) {
+    workers.push_back(std::make_unique<ParallelWorker>(state, done));
+    pool->start(workers.back().get());
+  }
+  
+  state.run();
+  
+  // Workers that are still queued are not needed anymore. Taking them back
+  // also stops nested calls from waiting on a pool that is already full.
+  int running = static_cast<int>(workerCount);
+  for (const std::unique_ptr<ParallelWorker> &worker : workers) {
+    if (pool->tryTake(worker.get())) --running;
+  }
+  done.acquire(running);
+}
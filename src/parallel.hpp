@@ -0,0 +1,20 @@
+﻿//
+//  parallel.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_parallel_hpp
+#define animera_parallel_hpp
+
+#include <cstddef>
+#include <functional>
+
+/// Call the function for each index in [0, count) on the global thread pool.
+/// The calling thread takes part so this can be safely nested. Returns after
+/// every call has returned. The order of the calls is unspecified.
+void parallelFor(std::size_t, const std::function<void(std::size_t)> &);
+
+#endif
@@ -29,8 +29,12 @@ bool PngAtlasGenerator::supported(const PixelFormat newPixelFormat, const Format
 }
 
 Error PngAtlasGenerator::beginAtlas(const AtlasInfo &info) {
+  if (info.trim) {
+    return "Trimming is not supported by the png generator";
+  }
   pixelFormat = info.pixelFormat;
   directory = info.directory;
+  paths.clear();
   return {};
 }
 
@@ -63,7 +67,8 @@ Error PngAtlasGenerator::setImageFormat(const Format newFormat, const PaletteCSp
 Error PngAtlasGenerator::copyImage(const std::size_t i, const QImage &image) {
   if (image.isNull()) return {};
   FileWriter writer;
-  TRY(writer.open(directory + '/' + names[i] + ".png"));
+  paths.push_back(directory + '/' + names[i] + ".png");
+  TRY(writer.open(paths.back()));
   TRY(exportCelPng(writer.dev(), palette, image, format, pixelFormat));
   return writer.flush();
 }
@@ -75,3 +80,7 @@ Error PngAtlasGenerator::copyWhiteImage(std::size_t) {
 Error PngAtlasGenerator::endAtlas() {
   return {};
 }
+
+std::vector<QString> PngAtlasGenerator::outputs() const {
+  return paths;
+}
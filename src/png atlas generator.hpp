@@ -28,6 +28,7 @@ public:
   Error copyWhiteImage(std::size_t) override;
   
   Error endAtlas() override;
+  std::vector<QString> outputs() const override;
 
 private:
   PixelFormat pixelFormat;
@@ -35,6 +36,7 @@ private:
   Format format;
   PaletteCSpan palette;
   std::vector<QString> names;
+  std::vector<QString> paths;
 };
 
 #endif
@@ -0,0 +1,41 @@
+﻿//
+//  recover dialog.cpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#include "recover dialog.hpp"
+
+#include "connect.hpp"
+#include "label widget.hpp"
+#include "config colors.hpp"
+#include <QtWidgets/qboxlayout.h>
+#include "text push button widget.hpp"
+
+RecoverDialog::RecoverDialog(QWidget *parent, const QString &name)
+  : Dialog{parent} {
+  setAttribute(Qt::WA_DeleteOnClose);
+  setWindowTitle("Recover");
+  setStyleSheet("background-color:" + glob_main.name());
+  
+  auto *layout = new QVBoxLayout{this};
+  layout->setSpacing(0);
+  layout->setContentsMargins(glob_margin, glob_margin, glob_margin, glob_margin);
+  
+  layout->addWidget(makeLabel(this, "Recover unsaved changes to " + name + "?"));
+  
+  auto *buttonLayout = new QHBoxLayout;
+  layout->addLayout(buttonLayout);
+  buttonLayout->setSpacing(0);
+  buttonLayout->setContentsMargins(0, 0, 0, 0);
+  
+  auto *recover = new TextPushButtonWidget{this, textBoxRect(8), "Recover"};
+  auto *discard = new TextPushButtonWidget{this, textBoxRect(8), "Discard"};
+  buttonLayout->addWidget(recover);
+  buttonLayout->addWidget(discard);
+  
+  CONNECT(recover, pressed, this, accept);
+  CONNECT(discard, pressed, this, reject);
+}
@@ -0,0 +1,22 @@
+﻿//
+//  recover dialog.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_recover_dialog_hpp
+#define animera_recover_dialog_hpp
+
+#include "dialog.hpp"
+
+/// Asks whether the recovery file of an animation should be opened. The
+/// dialog is accepted if the recovery file should be opened and rejected if
+/// it should be discarded.
+class RecoverDialog final : public Dialog {
+public:
+  RecoverDialog(QWidget *, const QString &);
+};
+
+#endif
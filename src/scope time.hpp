@@ -35,8 +35,9 @@ private:
     TreeNode *parent;
   };
   
-  static inline TreeNode tree {0, {}, {}, "ROOT", nullptr};
-  static inline TreeNode *current = &tree;
+  // Each thread records its own tree. Only the calling thread is printed.
+  static inline thread_local TreeNode tree {0, {}, {}, "ROOT", nullptr};
+  static inline thread_local TreeNode *current = &tree;
   
   static void printImpl(const TreeNode *, int);
   
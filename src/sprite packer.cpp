@@ -9,8 +9,10 @@
 #include "sprite packer.hpp"
 
 #include "zlib.hpp"
+#include "parallel.hpp"
 #include "composite.hpp"
 #include "export png.hpp"
+#include "scope time.hpp"
 #include <QtCore/qmath.h>
 #include <Graphics/copy.hpp>
 #include <Graphics/each.hpp>
@@ -21,32 +23,23 @@
 SpritePacker::SpritePacker(const DataFormat dataFormat)
   : dataFormat{dataFormat} {}
 
-void SpritePacker::init(const PixelFormat newFormat) {
-  texture = {};
-  rects.clear();
-  area = 0;
-  pixelFormat = newFormat;
-}
+namespace {
 
-void SpritePacker::append(const QSize size) {
-  stbrp_rect rect;
-  if (size.isEmpty()) {
-    rect.w = 0;
-    rect.h = 0;
-  } else {
-    rect.w = size.width() + 2 * padding;
-    rect.h = size.height() + 2 * padding;
-    area += rect.w * rect.h;
-  }
-  rects.push_back(rect);
+std::size_t rowBytes(const int width, const int depth) {
+  return static_cast<std::size_t>(width) * depth / 8;
 }
 
-void SpritePacker::appendWhite() {
-  append({1, 1});
+QByteArray compressRows(const QImage &image) {
+  const std::size_t rowSize = rowBytes(image.width(), image.depth());
+  QByteArray rows{static_cast<int>(rowSize * image.height()), Qt::Uninitialized};
+  char *dst = rows.data();
+  for (int y = 0; y != image.height(); ++y) {
+    std::memcpy(dst, image.constScanLine(y), rowSize);
+    dst += rowSize;
+  }
+  return qCompress(rows, 1);
 }
 
-namespace {
-
 QImage::Format toImageFormat(const PixelFormat format) {
   switch (format) {
     case PixelFormat::rgba:       return QImage::Format_ARGB32;
@@ -59,7 +52,120 @@ QImage::Format toImageFormat(const PixelFormat format) {
 
 }
 
+void SpritePacker::init(const PixelFormat newFormat, const bool newTrim) {
+  texture = {};
+  images.clear();
+  rects.clear();
+  sprites.clear();
+  hashes.clear();
+  area = 0;
+  pixelFormat = newFormat;
+  trim = newTrim;
+}
+
+Error SpritePacker::setFormat(const Format newFormat, const PaletteCSpan newPalette) {
+  palette = newPalette;
+  copyFunc = getCopyFunc(newFormat);
+  if (!copyFunc) {
+    return "Chosen pixel format conversion is not supported";
+  }
+  return {};
+}
+
+void SpritePacker::append(const QImage &image) {
+  if (image.isNull()) {
+    sprites.push_back({no_image, {}, {}});
+    return;
+  }
+  assert(copyFunc);
+  QImage converted{image.size(), toImageFormat(pixelFormat)};
+  (this->*copyFunc)(converted, image);
+  
+  const QRect bounds = trimBounds(converted);
+  if (bounds.isEmpty()) {
+    sprites.push_back({no_image, {}, image.size()});
+    return;
+  }
+  if (bounds != converted.rect()) {
+    converted = converted.copy(bounds);
+  }
+  appendImage(converted, bounds.topLeft(), image.size());
+}
+
+void SpritePacker::appendWhite() {
+  QImage white{1, 1, toImageFormat(pixelFormat)};
+  std::memset(white.bits(), 0xFF, white.sizeInBytes());
+  appendImage(white, {0, 0}, {1, 1});
+}
+
+QRect SpritePacker::trimBounds(const QImage &image) const {
+  if (!trim) return image.rect();
+  
+  // The alpha channel is stored in the last byte of each pixel because the
+  // texture has the same byte order as a PNG
+  int pixelBytes;
+  switch (pixelFormat) {
+    case PixelFormat::rgba:
+      pixelBytes = 4;
+      break;
+    case PixelFormat::gray_alpha:
+      pixelBytes = 2;
+      break;
+    default:
+      return image.rect();
+  }
+  
+  int left = image.width();
+  int right = -1;
+  int top = image.height();
+  int bottom = -1;
+  for (int y = 0; y != image.height(); ++y) {
+    const uchar *alpha = image.constScanLine(y) + pixelBytes - 1;
+    for (int x = 0; x != image.width(); ++x) {
+      if (alpha[x * pixelBytes]) {
+        left = std::min(left, x);
+        right = std::max(right, x);
+        top = std::min(top, y);
+        bottom = y;
+      }
+    }
+  }
+  if (right < 0) return {};
+  return {QPoint{left, top}, QPoint{right, bottom}};
+}
+
+void SpritePacker::appendImage(const QImage &image, const QPoint offset, const QSize size) {
+  // Images are compared after conversion so that sprites from animations with
+  // different formats or palettes can be shared if they look the same.
+  // Compression is deterministic so two images with the same size are the same
+  // if their compressed rows are the same.
+  const uint hash = hashImage(image);
+  const QByteArray compressed = compressRows(image);
+  const auto [begin, end] = hashes.equal_range(hash);
+  const auto found = std::find_if(begin, end, [&](const auto &pair) {
+    const stbrp_rect &rect = rects[pair.second];
+    return rect.w == image.width() + 2 * padding
+      && rect.h == image.height() + 2 * padding
+      && images[pair.second] == compressed;
+  });
+  if (found != end) {
+    sprites.push_back({found->second, offset, size});
+    return;
+  }
+  
+  const auto index = static_cast<std::uint32_t>(images.size());
+  stbrp_rect &rect = rects.emplace_back();
+  rect.w = image.width() + 2 * padding;
+  rect.h = image.height() + 2 * padding;
+  area += rect.w * rect.h;
+  hashes.emplace(hash, index);
+  sprites.push_back({index, offset, size});
+  images.push_back(compressed);
+}
+
 Error SpritePacker::pack() {
+  SCOPE_TIME("SpritePacker::pack");
+  
   int length = qNextPowerOfTwo(static_cast<int>(std::sqrt(area)));
   std::vector<stbrp_node> nodes;
   stbrp_context ctx;
@@ -79,36 +185,27 @@ Error SpritePacker::pack() {
   }
   texture = QImage{length, length, toImageFormat(pixelFormat)};
   clearImage(texture);
+  
+  uchar *bits = texture.bits();
+  const int pitch = texture.bytesPerLine();
+  const int depth = texture.depth();
+  parallelFor(images.size(), [&](const std::size_t i) {
+    const QByteArray rows = qUncompress(images[i]);
+    const std::size_t rowSize = rowBytes(rects[i].w - 2 * padding, depth);
+    const char *src = rows.constData();
+    uchar *dst = bits + (rects[i].y + padding) * pitch + (rects[i].x + padding) * depth / 8;
+    for (int y = 0; y != rects[i].h - 2 * padding; ++y) {
+      std::memcpy(dst, src, rowSize);
+      src += rowSize;
+      dst += pitch;
+    }
+  });
+  
+  images.clear();
+  hashes.clear();
   return {};
 }
 
-Error SpritePacker::setFormat(const Format newFormat, const PaletteCSpan newPalette) {
-  palette = newPalette;
-  copyFunc = getCopyFunc(newFormat);
-  if (!copyFunc) {
-    return "Chosen pixel format conversion is not supported";
-  }
-  return {};
-}
-
-QRect SpritePacker::copy(const std::size_t i, const QImage &image) {
-  assert(!image.isNull());
-  assert(!texture.isNull());
-  const QRect r = rect(i);
-  assert(r.size() == image.size());
-  assert(copyFunc);
-  (this->*copyFunc)(image, r.topLeft());
-  return r;
-}
-
-QRect SpritePacker::copyWhite(const std::size_t i) {
-  assert(!texture.isNull());
-  const QRect r = rect(i);
-  assert((r.size() == QSize{1, 1}));
-  texture.setPixel(r.topLeft(), 0xFFFFFFFF);
-  return r;
-}
-
 namespace {
 
 Error exportRaw(QIODevice &dev, const QImage &texture) {
@@ -180,7 +277,7 @@ Error SpritePacker::write(QIODevice &dev) {
 }
 
 std::size_t SpritePacker::count() const {
-  return rects.size();
+  return sprites.size();
 }
 
 int SpritePacker::width() const {
@@ -196,11 +293,20 @@ int SpritePacker::pitch() const {
 }
 
 QRect SpritePacker::rect(const std::size_t i) const {
-  assert(i < rects.size());
-  return {
-    rects[i].x + padding, rects[i].y + padding,
-    rects[i].w - 2 * padding, rects[i].h - 2 * padding
-  };
+  assert(i < sprites.size());
+  if (sprites[i].image == no_image) return {};
+  const stbrp_rect &r = rects[sprites[i].image];
+  return {r.x + padding, r.y + padding, r.w - 2 * padding, r.h - 2 * padding};
+}
+
+QPoint SpritePacker::offset(const std::size_t i) const {
+  assert(i < sprites.size());
+  return sprites[i].offset;
+}
+
+QSize SpritePacker::untrimmedSize(const std::size_t i) const {
+  assert(i < sprites.size());
+  return sprites[i].size;
 }
 
 SpritePacker::CopyFunc SpritePacker::getCopyFunc(const Format canvasFormat) const {
@@ -241,7 +347,8 @@ SpritePacker::CopyFunc SpritePacker::getCopyFunc(const Format canvasFormat) cons
 namespace {
 
 template <typename DstFmt, typename SrcFmt>
-void copyConvert(QImage &dstImage, const QImage &srcImage, const QPoint pos, SrcFmt srcFmt) {
+void copyConvert(QImage &dstImage, const QImage &srcImage, SrcFmt srcFmt) {
+  const QPoint pos{0, 0};
   gfx::Surface dst = makeSurface<gfx::Pixel<DstFmt>>(dstImage);
   gfx::Surface src = makeCSurface<gfx::Pixel<SrcFmt>>(srcImage);
   if constexpr (std::is_same_v<DstFmt, SrcFmt>) {
@@ -255,22 +362,22 @@ void copyConvert(QImage &dstImage, const QImage &srcImage, const QPoint pos, Src
 
 }
 
-void SpritePacker::copyRgbaToRgba(const QImage &image, const QPoint pos) {
-  copyConvert<RGBA>(texture, image, pos, FmtRgba{});
+void SpritePacker::copyRgbaToRgba(QImage &dst, const QImage &image) {
+  copyConvert<RGBA>(dst, image, FmtRgba{});
 }
 
-void SpritePacker::copyIndexToRgba(const QImage &image, const QPoint pos) {
-  copyConvert<RGBA>(texture, image, pos, FmtIndex{&palette[0].underlying()});
+void SpritePacker::copyIndexToRgba(QImage &dst, const QImage &image) {
+  copyConvert<RGBA>(dst, image, FmtIndex{&palette[0].underlying()});
 }
 
-void SpritePacker::copyGrayToRgba(const QImage &image, const QPoint pos) {
-  copyConvert<RGBA>(texture, image, pos, FmtGray{});
+void SpritePacker::copyGrayToRgba(QImage &dst, const QImage &image) {
+  copyConvert<RGBA>(dst, image, FmtGray{});
 }
 
-void SpritePacker::copyGrayToGray(const QImage &image, const QPoint pos) {
-  copyConvert<gfx::Y>(texture, image, pos, FmtGray{});
+void SpritePacker::copyGrayToGray(QImage &dst, const QImage &image) {
+  copyConvert<gfx::Y>(dst, image, FmtGray{});
 }
 
-void SpritePacker::copyGrayToGrayAlpha(const QImage &image, const QPoint pos) {
-  copyConvert<YA>(texture, image, pos, FmtGray{});
+void SpritePacker::copyGrayToGrayAlpha(QImage &dst, const QImage &image) {
+  copyConvert<YA>(dst, image, FmtGray{});
 }
@@ -10,6 +10,7 @@
 #define animera_sprite_packer_hpp
 
 #include <vector>
+#include <unordered_map>
 #include "error.hpp"
 #include "image.hpp"
 #include <QtCore/qrect.h>
@@ -22,46 +23,66 @@ enum class DataFormat {
   deflated
 };
 
+/// Sprites are converted to the pixel format of the texture as they are
+/// appended. If trimming is enabled, the transparent border is then removed
+/// from each sprite. Identical sprites are packed once and share a rectangle.
+/// Every distinct sprite is kept until the texture is packed, so they are
+/// kept compressed.
 class SpritePacker {
 public:
   static constexpr int padding = 1;
 
   explicit SpritePacker(DataFormat);
 
-  void init(PixelFormat);
-  void append(QSize);
+  void init(PixelFormat, bool);
+  Error setFormat(Format, PaletteCSpan);
+  void append(const QImage &);
   void appendWhite();
   
   Error pack();
-  Error setFormat(Format, PaletteCSpan);
-  QRect copy(std::size_t, const QImage &);
-  QRect copyWhite(std::size_t);
   Error write(QIODevice &);
   
   QRect rect(std::size_t) const;
+  QPoint offset(std::size_t) const;
+  QSize untrimmedSize(std::size_t) const;
   std::size_t count() const;
   int width() const;
   int height() const;
   int pitch() const;
   
 private:
+  static constexpr std::uint32_t no_image = ~std::uint32_t{};
+  
+  struct Sprite {
+    std::uint32_t image;
+    QPoint offset;
+    QSize size;
+  };
+
   QImage texture;
+  // The rows of each distinct image without padding, compressed with qCompress
+  std::vector<QByteArray> images;
   std::vector<stbrp_rect> rects;
+  std::vector<Sprite> sprites;
+  std::unordered_multimap<uint, std::uint32_t> hashes;
   int area = 0;
   PixelFormat pixelFormat;
   PaletteCSpan palette;
   DataFormat dataFormat;
+  bool trim = false;
   
-  using CopyFunc = void (SpritePacker::*)(const QImage &, QPoint);
+  using CopyFunc = void (SpritePacker::*)(QImage &, const QImage &);
   
   CopyFunc copyFunc = nullptr;
   
+  QRect trimBounds(const QImage &) const;
+  void appendImage(const QImage &, QPoint, QSize);
   CopyFunc getCopyFunc(Format) const;
-  void copyRgbaToRgba(const QImage &, QPoint);
-  void copyIndexToRgba(const QImage &, QPoint);
-  void copyGrayToRgba(const QImage &, QPoint);
-  void copyGrayToGray(const QImage &, QPoint);
-  void copyGrayToGrayAlpha(const QImage &, QPoint);
+  void copyRgbaToRgba(QImage &, const QImage &);
+  void copyIndexToRgba(QImage &, const QImage &);
+  void copyGrayToRgba(QImage &, const QImage &);
+  void copyGrayToGray(QImage &, const QImage &);
+  void copyGrayToGrayAlpha(QImage &, const QImage &);
 };
 
 #endif
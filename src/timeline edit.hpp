@@ -0,0 +1,55 @@
+﻿//
+//  timeline edit.hpp
+//  Animera
+//
+//  Created by Indiana Kernick on 16/10/26.
+//  Copyright © 2026 Indiana Kernick. All rights reserved.
+//
+
+#ifndef animera_timeline_edit_hpp
+#define animera_timeline_edit_hpp
+
+#include "cel array.hpp"
+#include "group array.hpp"
+
+/// Consecutive edits of the same kind to the same group are merged
+enum class EditMerge {
+  none,
+  group_name,
+  group_boundary
+};
+
+/// A structural change to the timeline that can be undone. An edit stores the
+/// parts of the timeline that it changed as they are on the other side of the
+/// edit. Applying the edit swaps them with the timeline so applying it again
+/// reverses it. Cels are moved in and out of the timeline so only the cels
+/// that were changed are stored.
+struct TimelineEdit {
+  struct CelRange {
+    LayerIdx layer;
+    FrameIdx begin;
+    /// The length of the range in the timeline
+    FrameIdx len;
+    std::vector<Cel> cels;
+  };
+  
+  /// A layer is removed from the timeline and stored if there is no layer,
+  /// otherwise the layer is inserted into the timeline
+  struct LayerSlot {
+    LayerIdx idx;
+    std::optional<Layer> layer;
+  };
+  
+  std::vector<CelRange> cels;
+  std::optional<LayerSlot> layerSlot;
+  std::optional<std::pair<LayerIdx, Layer>> layerReplace;
+  std::optional<std::pair<LayerIdx, LayerIdx>> layerSwap;
+  std::optional<std::vector<Group>> groups;
+  CelPos pos;
+  GroupIdx group;
+  FrameIdx frameCount;
+  EditMerge merge = EditMerge::none;
+  GroupIdx mergeGroup{};
+};
+
+#endif
@@ -9,10 +9,13 @@
 #include "timeline.hpp"
 
 #include "file io.hpp"
+#include "parallel.hpp"
 #include "composite.hpp"
 #include "scope time.hpp"
 #include "export png.hpp"
 #include "animation file.hpp"
+#include <deque>
+#include <unordered_map>
 
 Timeline::Timeline()
   : pos{LayerIdx{0}, FrameIdx{0}}, frameCount{0} {}
@@ -30,6 +33,7 @@ void Timeline::initDefault() {
   selection = empty_rect;
   group = GroupIdx{0};
   delay = ctrl_delay.def;
+  clearJournal();
   change();
 }
 
@@ -89,6 +93,7 @@ Error Timeline::openImage(
   selection = empty_rect;
   group = GroupIdx{0};
   delay = ctrl_delay.def;
+  clearJournal();
   return {};
 }
 
@@ -108,14 +113,14 @@ Error Timeline::importImage(const QString &path) {
   cel->img = std::move(image);
   ::shrinkCelImage(*cel, cel->rect());
   
+  changeLayerCels(pos.l);
   changeFrame();
   changeCelImage();
-  changeLayerCels(pos.l);
   Q_EMIT modified();
   return {};
 }
 
-Error Timeline::serializeHead(QIODevice &dev) const {
+Error Timeline::serializeHead(QIODevice &dev, const CelCompression &compression) const {
   SCOPE_TIME("Timeline::serializeHead");
 
   AnimationInfo info;
@@ -126,21 +131,138 @@ Error Timeline::serializeHead(QIODevice &dev) const {
   info.frames = frameCount;
   info.delay = delay;
   info.format = canvasFormat;
+  info.filter = compression.filter;
   return writeAHDR(dev, info);
 }
 
-Error Timeline::serializeBody(QIODevice &dev) const {
+namespace {
+
+// Maps each cel to the first cel that is identical to it. The unique cels are
+// stored in the order that they first appear.
+void findDuplicates(
+  std::vector<std::uint32_t> &refs,
+  std::vector<const CelImage *> &unique,
+  const std::vector<const CelImage *> &cels
+) {
+  SCOPE_TIME("findDuplicates");
+  
+  // Only the cels that have changed since they were last hashed are hashed
+  std::vector<uint> hashes(cels.size());
+  parallelFor(cels.size(), [&](const std::size_t c) {
+    const CelImage &cel = *cels[c];
+    const qint64 key = cel.img.cacheKey();
+    if (cel.hashKey != key) {
+      cel.hash = hashImage(cel.img);
+      cel.hashKey = key;
+    }
+    hashes[c] = cel.hash;
+  });
+  
+  std::unordered_multimap<uint, std::uint32_t> uniqueHashes;
+  refs.resize(cels.size());
+  unique.clear();
+  for (std::size_t c = 0; c != cels.size(); ++c) {
+    const auto [begin, end] = uniqueHashes.equal_range(hashes[c]);
+    const auto found = std::find_if(begin, end, [&](const auto &pair) {
+      return sameImage(unique[pair.second]->img, cels[c]->img);
+    });
+    if (found != end) {
+      refs[c] = found->second;
+    } else {
+      refs[c] = static_cast<std::uint32_t>(unique.size());
+      uniqueHashes.emplace(hashes[c], refs[c]);
+      unique.push_back(cels[c]);
+    }
+  }
+}
+
+bool chunkCached(const CelImage &cel, const CelCompression &compression) {
+  return cel.chunkKey == cel.img.cacheKey()
+    && reusableCompression(cel.chunkCompression, compression)
+    && !cel.chunk.isEmpty();
+}
+
+Error deflateCels(
+  const std::vector<const CelImage *> &cels,
+  const Format format,
+  const CelCompression &compression
+) {
+  SCOPE_TIME("deflateCels");
+  
+  // Each cel is written to its own buffer. Compressing a cel into a buffer
+  // produces the same bytes as compressing it straight into the file.
+  std::vector<Error> errors(cels.size());
+  parallelFor(cels.size(), [&](const std::size_t c) {
+    const CelImage &cel = *cels[c];
+    cel.chunk.clear();
+    cel.chunkKey = 0;
+    QBuffer buffer{&cel.chunk};
+    buffer.open(QIODevice::WriteOnly);
+    errors[c] = writeCDAT(buffer, cel.img, format, compression);
+    if (errors[c]) return;
+    cel.chunkKey = cel.img.cacheKey();
+    cel.chunkCompression = compression;
+  });
+  for (Error &error : errors) {
+    if (error) return std::move(error);
+  }
+  return {};
+}
+
+}
+
+Error Timeline::serializeBody(QIODevice &dev, const CelCompression &compression) const {
   SCOPE_TIME("Timeline::serializeBody");
 
-  TRY(writeGRPS(dev, groups));
+  // Identical cels are only written once. Later occurrences reference the
+  // first occurrence with a CREF chunk.
+  std::vector<const CelImage *> cels;
   for (const Layer &layer : layers) {
-    TRY(writeLHDR(dev, layer));
     for (const Cel &cel : layer.cels) {
+      if (*cel.cel) cels.push_back(cel.cel.get());
+    }
+  }
+  std::vector<std::uint32_t> refs;
+  std::vector<const CelImage *> unique;
+  findDuplicates(refs, unique, cels);
+  
+  // The cels that have changed since they were last saved are compressed in
+  // parallel. Then all chunks are spliced into the file in layer and cel
+  // order.
+  std::vector<const CelImage *> dirty;
+  for (const CelImage *cel : unique) {
+    if (!chunkCached(*cel, compression)) dirty.push_back(cel);
+  }
+  TRY(deflateCels(dirty, canvasFormat, compression));
+
+  TRY(writeGRPS(dev, groups));
+  std::vector<LayerIndex> index(layers.size());
+  std::vector<qint64> dataPos;
+  auto ref = refs.cbegin();
+  for (std::size_t l = 0; l != layers.size(); ++l) {
+    index[l].header = dev.pos();
+    TRY(writeLHDR(dev, layers[l]));
+    FrameIdx frame{};
+    for (const Cel &cel : layers[l].cels) {
+      CelIndex &celIndex = index[l].cels.emplace_back();
+      celIndex.frame = frame;
+      celIndex.header = dev.pos();
       TRY(writeCHDR(dev, cel));
-      if (*cel.cel) TRY(writeCDAT(dev, cel.cel->img, canvasFormat));
+      celIndex.data = 0;
+      if (*cel.cel) {
+        if (*ref == dataPos.size()) {
+          celIndex.data = dataPos.emplace_back(dev.pos());
+          TRY(writeCDAT(dev, unique[*ref]->chunk));
+        } else {
+          celIndex.data = dataPos[*ref];
+          TRY(writeCREF(dev, *ref));
+        }
+        ++ref;
+      }
+      frame += cel.len;
     }
   }
-  return {};
+  return writeINDX(dev, index);
 }
 
 Error Timeline::serializeTail(QIODevice &dev) const {
@@ -156,24 +278,138 @@ Error Timeline::deserializeHead(QIODevice &dev, Format &format, QSize &size) {
   TRY(readAHDR(dev, info));
   canvasSize = size = {info.width, info.height};
   layers.resize(+info.layers);
+  cursors.assign(layers.size(), {});
+  clearJournal();
   groups.resize(+info.groups);
   frameCount = info.frames;
   canvasFormat = format = info.format;
   delay = info.delay;
+  celFilter = info.filter;
   return {};
 }
 
+namespace {
+
+Error inflateCels(
+  const CelBuffer &buffer,
+  const std::vector<CelData> &cels,
+  const Format format,
+  const bool filter
+) {
+  SCOPE_TIME("inflateCels");
+  
+  // Each cel is inflated into its own image so the only thing shared between
+  // threads is the read-only buffer. The errors are reported in file order.
+  std::vector<Error> errors(cels.size());
+  parallelFor(cels.size(), [&](const std::size_t c) {
+    errors[c] = inflateCDAT(buffer.data(), cels[c], format, filter);
+  });
+  for (Error &error : errors) {
+    if (error) return std::move(error);
+  }
+  return {};
+}
+
+}
+
 Error Timeline::deserializeBody(QIODevice &dev) {
-  SCOPE_TIME("Timeline::deserializeBody");
+  const CelRect all = {LayerIdx{0}, FrameIdx{0}, layerCount() - LayerIdx{1}, frameCount - FrameIdx{1}};
+  return deserializeBody(dev, all);
+}
 
+Error Timeline::deserializeBody(QIODevice &dev, CelRect rect) {
+  SCOPE_TIME("Timeline::deserializeBody");
+  
+  // Negative indices are relative to the end as they are for export
+  if (rect.minL < LayerIdx{0}) rect.minL += layerCount();
+  if (rect.maxL < LayerIdx{0}) rect.maxL += layerCount();
+  if (rect.minF < FrameIdx{0}) rect.minF += frameCount;
+  if (rect.maxF < FrameIdx{0}) rect.maxF += frameCount;
+
+  // The chunks are read and checked first. Then the cels are inflated in
+  // parallel once all of the compressed data is in memory. Cels outside of
+  // the rectangle are skipped and left null.
   TRY(readGRPS(dev, groups, frameCount));
-  for (Layer &layer : layers) {
+  CelBuffer buffer;
+  std::vector<CelData> cels;
+  
+  // Cels that reference another cel share its image once it is inflated. If
+  // the referenced cel was skipped, its data is read into a hidden image.
+  struct Source {
+    qint64 pos;
+    QSize size;
+    QImage *image;
+  };
+  std::vector<Source> sources;
+  std::deque<QImage> hidden;
+  std::vector<std::pair<QImage *, std::uint32_t>> refs;
+  std::vector<std::pair<const CelImage *, std::size_t>> chunks;
+  
+  for (LayerIdx l{}; l != layerCount(); ++l) {
+    Layer &layer = layers[+l];
     TRY(readLHDR(dev, layer));
+    const bool layerSelected = rect.minL <= l && l <= rect.maxL;
+    FrameIdx frame{};
     for (Cel &cel : layer.cels) {
       TRY(readCHDR(dev, cel, canvasFormat));
-      if (*cel.cel) TRY(readCDAT(dev, cel.cel->img, canvasFormat));
+      cel.start = frame;
+      const bool selected = layerSelected && frame <= rect.maxF && rect.minF < frame + cel.len;
+      frame += cel.len;
+      if (!*cel.cel) continue;
+      
+      std::optional<std::uint32_t> ref;
+      TRY(readCREF(dev, ref, static_cast<std::uint32_t>(sources.size())));
+      if (ref) {
+        Source &source = sources[*ref];
+        if (source.size != cel.cel->img.size()) {
+          return "Cel reference size mismatch";
+        }
+        if (!selected) {
+          *cel.cel = {};
+          continue;
+        }
+        if (!source.image) {
+          const qint64 pos = dev.pos();
+          source.image = &hidden.emplace_back(source.size, qimageFormat(canvasFormat));
+          CelData &data = cels.emplace_back();
+          data.image = source.image;
+          if (!dev.seek(source.pos)) return dev.errorString();
+          TRY(readCDAT(dev, data, buffer));
+          if (!dev.seek(pos)) return dev.errorString();
+        }
+        cel.cel->img = {};
+        refs.emplace_back(&cel.cel->img, *ref);
+        continue;
+      }
+      
+      Source &source = sources.emplace_back();
+      source.pos = dev.pos();
+      source.size = cel.cel->img.size();
+      source.image = nullptr;
+      if (selected) {
+        chunks.emplace_back(cel.cel.get(), cels.size());
+        CelData &data = cels.emplace_back();
+        data.image = source.image = &cel.cel->img;
+        TRY(readCDAT(dev, data, buffer));
+      } else {
+        TRY(skipCDAT(dev));
+        *cel.cel = {};
+      }
     }
   }
+  
+  TRY(inflateCels(buffer, cels, canvasFormat, celFilter));
+  for (const auto &[image, ref] : refs) {
+    *image = *sources[ref].image;
+  }
+  
+  // The chunks that were read are cached so that the next save doesn't need
+  // to compress the cels again
+  for (const auto &[cel, c] : chunks) {
+    cel->chunk = copyCDAT(buffer.data(), cels[c]);
+    cel->chunkKey = cel->img.cacheKey();
+    cel->chunkCompression = compressionCDAT(buffer.data(), cels[c], celFilter);
+  }
   return {};
 }
 
@@ -215,6 +451,66 @@ tcb::span<const Group> Timeline::getGroupArray() const {
   return groups;
 }
 
+void Timeline::countMemory(ImageMemory &memory) const {
+  for (const Layer &layer : layers) {
+    for (const Cel &cel : layer.cels) {
+      memory.add(cel.cel->img);
+    }
+  }
+  for (const std::vector<Cel> &cels : clipboard) {
+    for (const Cel &cel : cels) {
+      memory.add(cel.cel->img);
+    }
+  }
+  for (const TimelineEdit &edit : journal) {
+    for (const TimelineEdit::CelRange &range : edit.cels) {
+      for (const Cel &cel : range.cels) {
+        memory.add(cel.cel->img);
+      }
+    }
+    const Layer *layer = nullptr;
+    if (edit.layerSlot && edit.layerSlot->layer) layer = &*edit.layerSlot->layer;
+    if (edit.layerReplace) layer = &edit.layerReplace->second;
+    if (layer) {
+      for (const Cel &cel : layer->cels) {
+        memory.add(cel.cel->img);
+      }
+    }
+  }
+}
+
+void Timeline::snapshot(Timeline &copy) const {
+  copy.layers.resize(layers.size());
+  for (std::size_t l = 0; l != layers.size(); ++l) {
+    copy.layers[l].cels = extractCelArray(layers[l].cels, FrameIdx{0}, frameCount);
+    copy.layers[l].name = layers[l].name;
+    copy.layers[l].visible = layers[l].visible;
+  }
+  copy.groups = groups;
+  copy.frameCount = frameCount;
+  copy.canvasSize = canvasSize;
+  copy.canvasFormat = canvasFormat;
+  copy.delay = delay;
+}
+
+bool Timeline::isLocked() const {
+  return locked;
+}
+
+void Timeline::undoEdit() {
+  if (locked) return;
+  if (journalTop == 0) return;
+  --journalTop;
+  applyEdit(journal[journalTop]);
+}
+
+void Timeline::redoEdit() {
+  if (locked) return;
+  if (journalTop == journal.size()) return;
+  applyEdit(journal[journalTop]);
+  ++journalTop;
+}
+
 void Timeline::initCanvas(const Format format, const QSize size) {
   canvasFormat = format;
   canvasSize = size;
@@ -304,6 +600,7 @@ void Timeline::insertLayer() {
   Layer layer;
   clearCelArray(layer.cels, frameCount);
   layer.name = "Layer " + std::to_string(layers.size());
+  beginEdit().layerSlot = {pos.l, std::nullopt};
   layers.insert(layers.begin() + +pos.l, std::move(layer));
   changeLayerCount();
   Q_EMIT selectionChanged(selection);
@@ -316,12 +613,16 @@ void Timeline::insertLayer() {
 void Timeline::removeLayer() {
   if (locked) return;
   const QRect rect = getCel(pos)->rect();
+  TimelineEdit &edit = beginEdit();
   if (layers.size() == 1) {
+    edit.layerReplace = {LayerIdx{0}, std::move(layers.front())};
+    layers.front() = {};
     clearCelArray(layers.front().cels, frameCount);
     layers.front().name = "Layer 0";
     layers.front().visible = true;
     changeLayers(LayerIdx{0}, LayerIdx{1});
   } else {
+    edit.layerSlot = {pos.l, std::move(layers[+pos.l])};
     layers.erase(layers.begin() + +pos.l);
     changeLayerCount();
     Q_EMIT selectionChanged(selection);
@@ -337,6 +638,7 @@ void Timeline::removeLayer() {
 void Timeline::moveLayerUp() {
   if (locked) return;
   if (pos.l == LayerIdx{0}) return;
+  beginEdit().layerSwap = {pos.l - LayerIdx{1}, pos.l};
   std::swap(layers[+(pos.l - LayerIdx{1})], layers[+pos.l]);
   changeLayers(pos.l - LayerIdx{1}, pos.l + LayerIdx{1});
   changeFrame();
@@ -350,6 +652,7 @@ void Timeline::moveLayerUp() {
 void Timeline::moveLayerDown() {
   if (locked) return;
   if (pos.l == layerCount() - LayerIdx{1}) return;
+  beginEdit().layerSwap = {pos.l, pos.l + LayerIdx{1}};
   std::swap(layers[+pos.l], layers[+(pos.l + LayerIdx{1})]);
   changeLayers(pos.l, pos.l + LayerIdx{2});
   changeFrame();
@@ -362,6 +665,11 @@ void Timeline::moveLayerDown() {
 
 void Timeline::insertFrame() {
   if (locked) return;
+  TimelineEdit &edit = beginEdit();
+  for (LayerIdx l = {}; l != layerCount(); ++l) {
+    recordCels(edit, l, pos.f, pos.f);
+  }
+  edit.groups = groups;
   ++frameCount;
   changeFrameCount();
   for (LayerIdx l = {}; l != layerCount(); ++l) {
@@ -371,6 +679,7 @@ void Timeline::insertFrame() {
   Q_EMIT selectionChanged(selection);
   insertGroupFrame(groups, pos.f);
   ++pos.f;
+  finishEdit(edit);
   changeGroupArray();
   changeFrame();
   changeCelImage();
@@ -380,6 +689,11 @@ void Timeline::insertFrame() {
 
 void Timeline::removeFrame() {
   if (locked) return;
+  TimelineEdit &edit = beginEdit();
+  for (LayerIdx l = {}; l != layerCount(); ++l) {
+    recordCels(edit, l, pos.f, pos.f);
+  }
+  edit.groups = groups;
   if (frameCount == FrameIdx{1}) {
     for (LayerIdx l = {}; l != layerCount(); ++l) {
       clearCelArray(layers[+l].cels, FrameIdx{1});
@@ -401,6 +715,7 @@ void Timeline::removeFrame() {
     changeGroupArray();
   }
   pos.f = std::max(pos.f - FrameIdx{1}, FrameIdx{0});
+  finishEdit(edit);
   changeFrame();
   changeCelImage();
   changePos();
@@ -411,6 +726,9 @@ void Timeline::clearCel() {
   if (locked) return;
   Layer &layer = layers[+pos.l];
   const QRect rect = getImage(layer.cels, pos.f)->rect();
+  if (!rect.isEmpty()) {
+    recordCels(beginEdit(), pos.l, pos.f, pos.f);
+  }
   replaceCelFrame(layer.cels, pos.f, false);
   changeLayerCels(pos.l);
   changeFrame();
@@ -421,6 +739,10 @@ void Timeline::clearCel() {
 
 void Timeline::extendCel() {
   if (locked) return;
+  const FrameIdx next = celEnd(layers[+pos.l].cels, pos.f);
+  if (next < frameCount) {
+    recordCels(beginEdit(), pos.l, pos.f, next);
+  }
   ::extendCel(layers[+pos.l].cels, pos.f);
   changeLayerCels(pos.l);
   nextFrame();
@@ -429,6 +751,9 @@ void Timeline::extendCel() {
 
 void Timeline::splitCel() {
   if (locked) return;
+  if (celBegin(layers[+pos.l].cels, pos.f) != pos.f) {
+    recordCels(beginEdit(), pos.l, pos.f, pos.f);
+  }
   ::splitCel(layers[+pos.l].cels, pos.f);
   changeLayerCels(pos.l);
   changeFrame();
@@ -476,13 +801,16 @@ void Timeline::setGroup(const FrameIdx frame) {
 }
 
 void Timeline::setGroupName(const std::string_view name) {
+  recordGroups(groups, EditMerge::group_name, group);
   groups[+group].name = name;
   Q_EMIT modified();
 }
 
 void Timeline::moveGroup(const GroupIdx idx, const FrameIdx end) {
   if (locked) return;
+  std::vector<Group> oldGroups = groups;
   if (moveGroupBoundary(groups, idx, end)) {
+    recordGroups(std::move(oldGroups), EditMerge::group_boundary, idx);
     Q_EMIT groupArrayChanged(groups);
     if (idx == group || idx + GroupIdx{1} == group) {
       changeGroup(pos.f);
@@ -492,7 +820,9 @@ void Timeline::moveGroup(const GroupIdx idx, const FrameIdx end) {
 
 void Timeline::splitGroupLeft() {
   if (locked) return;
+  std::vector<Group> oldGroups = groups;
   if (::splitGroupLeft(groups, pos.f)) {
+    recordGroups(std::move(oldGroups));
     ++group;
     changeGroupArray();
   }
@@ -500,7 +830,9 @@ void Timeline::splitGroupLeft() {
 
 void Timeline::splitGroupRight() {
   if (locked) return;
+  std::vector<Group> oldGroups = groups;
   if (::splitGroupRight(groups, pos.f)) {
+    recordGroups(std::move(oldGroups));
     ++group;
     changeGroupArray();
     Q_EMIT groupNameChanged(groups[+group].name);
@@ -509,7 +841,9 @@ void Timeline::splitGroupRight() {
 
 void Timeline::mergeGroupLeft() {
   if (locked) return;
+  std::vector<Group> oldGroups = groups;
   if (::mergeGroupLeft(groups, group)) {
+    recordGroups(std::move(oldGroups));
     --group;
     changeGroupArray();
   }
@@ -517,7 +851,9 @@ void Timeline::mergeGroupLeft() {
 
 void Timeline::mergeGroupRight() {
   if (locked) return;
+  std::vector<Group> oldGroups = groups;
   if (::mergeGroupRight(groups, group)) {
+    recordGroups(std::move(oldGroups));
     changeGroupArray();
   }
 }
@@ -598,6 +934,12 @@ void Timeline::setDelay(const int newDelay) {
 
 void Timeline::clearSelected() {
   if (locked) return;
+  if (selection.minL <= selection.maxL) {
+    TimelineEdit &edit = beginEdit();
+    for (LayerIdx l = selection.minL; l <= selection.maxL; ++l) {
+      recordCels(edit, l, selection.minF, selection.maxF);
+    }
+  }
   std::vector<Cel> nullCels;
   clearCelArray(nullCels, selection.maxF - selection.minF + FrameIdx{1});
   for (LayerIdx l = selection.minL; l <= selection.maxL; ++l) {
@@ -627,6 +969,10 @@ void Timeline::pasteSelected() {
     layerCount(), selection.minL + static_cast<LayerIdx>(clipboard.size())
   );
   const FrameIdx frames = selection.maxF - selection.minF + FrameIdx{1};
+  TimelineEdit &edit = beginEdit();
+  for (LayerIdx l = selection.minL; l < endLayer; ++l) {
+    recordCels(edit, l, selection.minF, selection.maxF);
+  }
   for (LayerIdx l = selection.minL; l < endLayer; ++l) {
     std::vector<Cel> cels = truncateCopyCelArray(clipboard[+(l - selection.minL)], frames);
     replaceCelArray(layers[+l].cels, selection.minF, cels);
@@ -652,12 +998,13 @@ CelImage *Timeline::getCel(const CelPos cel) {
   return getImage(layers[+cel.l].cels, cel.f);
 }
 
-Frame Timeline::getFrame(const FrameIdx idx) const {
-  Frame frame;
-  frame.reserve(layers.size());
-  for (const Layer &layer : layers) {
-    if (layer.visible) {
-      frame.push_back(getImage(layer.cels, idx));
+const Frame &Timeline::getFrame(const FrameIdx idx) {
+  // The frame is reused to avoid allocating while stepping through frames
+  assert(cursors.size() == layers.size());
+  frame.clear();
+  for (std::size_t l = 0; l != layers.size(); ++l) {
+    if (layers[l].visible) {
+      frame.push_back(getImage(layers[l].cels, cursors[l], idx));
     }
   }
   return frame;
@@ -677,12 +1024,14 @@ void Timeline::changeFrame() {
 }
 
 void Timeline::changeLayerCels(const LayerIdx idx) {
+  cursors[+idx] = {};
   Q_EMIT layerCelsChanged(idx, layers[+idx].cels);
 }
 
 void Timeline::changeLayers(const LayerIdx begin, const LayerIdx end) {
   assert(begin < end);
   for (LayerIdx l = begin; l != end; ++l) {
+    cursors[+l] = {};
     Q_EMIT layerCelsChanged(l, layers[+l].cels);
     Q_EMIT visibilityChanged(l, layers[+l].visible);
     Q_EMIT layerNameChanged(l, layers[+l].name);
@@ -694,6 +1043,7 @@ void Timeline::changeFrameCount() {
 }
 
 void Timeline::changeLayerCount() {
+  cursors.assign(layers.size(), {});
   Q_EMIT layerCountChanged(layerCount());
 }
 
@@ -718,4 +1068,81 @@ void Timeline::changeGroupArray() {
   Q_EMIT groupChanged(getGroup(groups, group));
 }
 
+void Timeline::clearJournal() {
+  journal.clear();
+  journalTop = 0;
+}
+
+TimelineEdit &Timeline::beginEdit() {
+  journal.erase(journal.begin() + journalTop, journal.end());
+  if (journal.size() >= edit_timeline_journal) {
+    journal.erase(journal.begin());
+  }
+  TimelineEdit &edit = journal.emplace_back();
+  edit.pos = pos;
+  edit.group = group;
+  edit.frameCount = frameCount;
+  journalTop = journal.size();
+  return edit;
+}
+
+void Timeline::recordCels(TimelineEdit &edit, const LayerIdx l, const FrameIdx first, const FrameIdx last) {
+  // Cels that are partially covered by the range are recorded whole because
+  // the edit might merge or split them
+  const std::vector<Cel> &cels = layers[+l].cels;
+  const FrameIdx begin = celBegin(cels, first);
+  const FrameIdx len = celEnd(cels, last) - begin;
+  edit.cels.push_back({l, begin, len, extractCelArray(cels, begin, len)});
+}
+
+void Timeline::recordGroups(std::vector<Group> oldGroups, const EditMerge merge, const GroupIdx mergeGroup) {
+  if (merge != EditMerge::none && journalTop == journal.size() && !journal.empty()) {
+    const TimelineEdit &last = journal.back();
+    if (last.merge == merge && last.mergeGroup == mergeGroup) return;
+  }
+  TimelineEdit &edit = beginEdit();
+  edit.groups = std::move(oldGroups);
+  edit.merge = merge;
+  edit.mergeGroup = mergeGroup;
+}
+
+void Timeline::finishEdit(TimelineEdit &edit) {
+  // Inserting or removing frames changes the length of the recorded ranges
+  const FrameIdx delta = frameCount - edit.frameCount;
+  for (TimelineEdit::CelRange &range : edit.cels) {
+    range.len = range.len + delta;
+  }
+}
+
+void Timeline::applyEdit(TimelineEdit &edit) {
+  for (TimelineEdit::CelRange &range : edit.cels) {
+    swapCelRange(layers[+range.layer].cels, range.begin, range.len, range.cels);
+  }
+  if (edit.layerSlot) {
+    const auto iter = layers.begin() + +edit.layerSlot->idx;
+    if (edit.layerSlot->layer) {
+      layers.insert(iter, std::move(*edit.layerSlot->layer));
+      edit.layerSlot->layer.reset();
+    } else {
+      edit.layerSlot->layer = std::move(*iter);
+      layers.erase(iter);
+    }
+  }
+  if (edit.layerReplace) {
+    std::swap(layers[+edit.layerReplace->first], edit.layerReplace->second);
+  }
+  if (edit.layerSwap) {
+    std::swap(layers[+edit.layerSwap->first], layers[+edit.layerSwap->second]);
+  }
+  if (edit.groups) {
+    std::swap(groups, *edit.groups);
+  }
+  std::swap(pos, edit.pos);
+  std::swap(group, edit.group);
+  std::swap(frameCount, edit.frameCount);
+  selection = empty_rect;
+  change();
+  Q_EMIT modified();
+}
+
 #include "timeline.moc"
@@ -13,6 +13,8 @@
 #include "cel array.hpp"
 #include "group array.hpp"
 #include "palette span.hpp"
+#include "image memory.hpp"
+#include "timeline edit.hpp"
 
 // TODO: can we make the interface of Timeline smaller?
 
@@ -46,12 +48,13 @@ public:
   Error openImage(const QString &, PaletteSpan, Format &, QSize &);
   Error importImage(const QString &);
 
-  Error serializeHead(QIODevice &) const;
-  Error serializeBody(QIODevice &) const;
+  Error serializeHead(QIODevice &, const CelCompression &) const;
+  Error serializeBody(QIODevice &, const CelCompression &) const;
   Error serializeTail(QIODevice &) const;
 
   Error deserializeHead(QIODevice &, Format &, QSize &);
   Error deserializeBody(QIODevice &);
+  Error deserializeBody(QIODevice &, CelRect);
   Error deserializeTail(QIODevice &);
 
   LayerIdx getLayers() const;
@@ -62,6 +65,17 @@ public:
   
   tcb::span<const Layer> getLayerArray() const;
   tcb::span<const Group> getGroupArray() const;
+  
+  void countMemory(ImageMemory &) const;
+  /// Copy the parts of the timeline that are saved. Cel images are shared
+  /// with the copy.
+  void snapshot(Timeline &) const;
+  bool isLocked() const;
+  
+  /// Undo the last structural edit, such as inserting a frame or pasting cels
+  void undoEdit();
+  /// Redo the last structural edit that was undone
+  void redoEdit();
 
 public Q_SLOTS:
   void initCanvas(Format, QSize);
@@ -138,7 +152,11 @@ Q_SIGNALS:
   
 private:
   std::vector<Layer> layers;
+  std::vector<CelCursor> cursors;
+  Frame frame;
   std::vector<std::vector<Cel>> clipboard;
+  std::vector<TimelineEdit> journal;
+  std::size_t journalTop = 0;
   std::vector<Group> groups;
   CelPos pos;
   CelRect selection;
@@ -147,10 +165,11 @@ private:
   QSize canvasSize;
   Format canvasFormat;
   int delay;
+  bool celFilter = false;
   bool locked = false;
   
   CelImage *getCel(CelPos);
-  Frame getFrame(FrameIdx) const;
+  const Frame &getFrame(FrameIdx);
   LayerIdx layerCount() const;
   
   void changePos();
@@ -163,6 +182,13 @@ private:
   void changeCelImage();
   GroupInfo changeGroup(FrameIdx);
   void changeGroupArray();
+  
+  void clearJournal();
+  TimelineEdit &beginEdit();
+  void recordCels(TimelineEdit &, LayerIdx, FrameIdx, FrameIdx);
+  void recordGroups(std::vector<Group>, EditMerge = EditMerge::none, GroupIdx = {});
+  void finishEdit(TimelineEdit &);
+  void applyEdit(TimelineEdit &);
 };
 
 #endif
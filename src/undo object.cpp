@@ -21,6 +21,10 @@ void UndoObject::setCelImage(CelImage *newCel) {
   cel = newCel;
 }
 
+void UndoObject::countMemory(ImageMemory &memory) const {
+  stack.countMemory(memory);
+}
+
 void UndoObject::keyPress(const Qt::Key key) {
   if (key == key_undo) {
     undo();
@@ -20,6 +20,8 @@ class UndoObject final : public QObject {
 public:
   explicit UndoObject(QObject *);
   
+  void countMemory(ImageMemory &) const;
+  
 public Q_SLOTS:
   void setCelImage(CelImage *);
   void keyPress(Qt::Key);
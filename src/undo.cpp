@@ -8,56 +8,329 @@
 
 #include "undo.hpp"
 
+#include <mutex>
+#include <cstring>
+#include "scope time.hpp"
+#include <QtCore/qrunnable.h>
 #include "config geometry.hpp"
+#include <QtCore/qthreadpool.h>
 
-UndoStack::UndoStack() {
-  stack.reserve(edit_undo_stack);
-  top = -1;
+/// The pixels of a tile packed into rows without padding. The pixels are
+/// compressed by a TileCompressor after they have been recorded.
+class UndoTilePixels {
+public:
+  explicit UndoTilePixels(QByteArray raw)
+    : data{std::move(raw)} {}
+  
+  QByteArray pixels() const {
+    std::lock_guard lock{mutex};
+    return compressed ? qUncompress(data) : data;
+  }
+  
+  std::size_t size() const {
+    std::lock_guard lock{mutex};
+    return static_cast<std::size_t>(data.size());
+  }
+  
+  bool pending() const {
+    std::lock_guard lock{mutex};
+    return !attempted;
+  }
+  
+  void compress() {
+    QByteArray raw;
+    {
+      std::lock_guard lock{mutex};
+      if (attempted) return;
+      raw = data;
+    }
+    QByteArray packed = qCompress(raw, 1);
+    std::lock_guard lock{mutex};
+    attempted = true;
+    if (packed.size() < data.size()) {
+      data = std::move(packed);
+      compressed = true;
+    }
+  }
+
+private:
+  mutable std::mutex mutex;
+  QByteArray data;
+  bool compressed = false;
+  bool attempted = false;
+};
+
+namespace {
+
+class TileCompressor final : public QRunnable {
+public:
+  explicit TileCompressor(std::vector<std::weak_ptr<UndoTilePixels>> tiles)
+    : tiles{std::move(tiles)} {}
+  
+  void run() override {
+    SCOPE_TIME("TileCompressor::run");
+    
+    // Tiles of steps that have been discarded are skipped
+    for (const std::weak_ptr<UndoTilePixels> &weak : tiles) {
+      if (const std::shared_ptr<UndoTilePixels> tile = weak.lock()) {
+        tile->compress();
+      }
+    }
+  }
+
+private:
+  std::vector<std::weak_ptr<UndoTilePixels>> tiles;
+};
+
+void compressTiles(const std::vector<std::shared_ptr<UndoTilePixels>> &tiles) {
+  if (tiles.empty()) return;
+  std::vector<std::weak_ptr<UndoTilePixels>> weak{tiles.begin(), tiles.end()};
+  QThreadPool::globalInstance()->start(new TileCompressor{std::move(weak)});
+}
+
+bool sameGeometry(const CelImage &a, const CelImage &b) {
+  return a.pos == b.pos && a.img.size() == b.img.size() && a.img.format() == b.img.format();
+}
+
+// Tiles can only be recorded between two images with the same format
+bool tileable(const CelImage &a, const CelImage &b) {
+  return !a.isNull() && !b.isNull() && a.img.format() == b.img.format();
+}
+
+QRect tileRect(const QImage &image, const QPoint pos) {
+  return QRect{pos, QSize{edit_undo_tile, edit_undo_tile}}.intersected(image.rect());
+}
+
+std::size_t tileRowSize(const QImage &image, const QRect rect) {
+  return static_cast<std::size_t>(rect.width()) * image.depth() / 8;
+}
+
+// The rectangle of a is moved by the offset to get the rectangle of b
+bool sameTile(const QImage &a, const QImage &b, const QRect rect, const QPoint offset) {
+  const std::size_t offsetA = tileRowSize(a, {0, 0, rect.x(), 1});
+  const std::size_t offsetB = tileRowSize(b, {0, 0, rect.x() + offset.x(), 1});
+  const std::size_t size = tileRowSize(a, rect);
+  for (int y = rect.top(); y <= rect.bottom(); ++y) {
+    const uchar *rowA = a.constScanLine(y) + offsetA;
+    const uchar *rowB = b.constScanLine(y + offset.y()) + offsetB;
+    if (std::memcmp(rowA, rowB, size) != 0) return false;
+  }
+  return true;
+}
+
+// Copy the pixels that the two cels have in common from src to dst
+void copyOverlap(CelImage &dst, const CelImage &src) {
+  const QRect overlap = dst.rect().intersected(src.rect());
+  if (overlap.isEmpty()) return;
+  const QRect dstRect = overlap.translated(-dst.pos);
+  const QRect srcRect = overlap.translated(-src.pos);
+  const std::size_t dstOffset = tileRowSize(dst.img, {0, 0, dstRect.x(), 1});
+  const std::size_t srcOffset = tileRowSize(src.img, {0, 0, srcRect.x(), 1});
+  const std::size_t size = tileRowSize(dst.img, dstRect);
+  for (int y = 0; y != overlap.height(); ++y) {
+    std::memcpy(
+      dst.img.scanLine(dstRect.y() + y) + dstOffset,
+      src.img.constScanLine(srcRect.y() + y) + srcOffset,
+      size
+    );
+  }
+}
+
+QByteArray readTile(const QImage &image, const QRect rect) {
+  const std::size_t offset = tileRowSize(image, {0, 0, rect.x(), 1});
+  const std::size_t size = tileRowSize(image, rect);
+  QByteArray raw{static_cast<int>(size * rect.height()), Qt::Uninitialized};
+  char *dst = raw.data();
+  for (int y = rect.top(); y <= rect.bottom(); ++y) {
+    std::memcpy(dst, image.constScanLine(y) + offset, size);
+    dst += size;
+  }
+  return raw;
+}
+
+void writeTile(QImage &image, const QRect rect, const QByteArray &raw) {
+  const std::size_t offset = tileRowSize(image, {0, 0, rect.x(), 1});
+  const std::size_t size = tileRowSize(image, rect);
+  assert(static_cast<std::size_t>(raw.size()) == size * rect.height());
+  const char *src = raw.constData();
+  for (int y = rect.top(); y <= rect.bottom(); ++y) {
+    std::memcpy(image.scanLine(y) + offset, src, size);
+    src += size;
+  }
 }
 
+}
+
+UndoStack::UndoStack() = default;
+
 bool UndoStack::empty() const {
-  return stack.empty();
+  return !initialized;
 }
 
 void UndoStack::clear() {
-  stack.clear();
-  top = -1;
+  steps.clear();
+  top = 0;
+  current = {};
+  initialized = false;
 }
 
 void UndoStack::reset(CelImage cel) {
-  stack.clear();
-  cel.img.detach();
-  stack.push_back(std::move(cel));
+  steps.clear();
   top = 0;
+  current = std::move(cel);
+  initialized = true;
 }
 
 void UndoStack::modify(CelImage cel) {
-  assert(!stack.empty());
-  stack.erase(stack.begin() + top + 1, stack.end());
-  if (stack.size() >= edit_undo_stack) {
-    const std::size_t oldImages = stack.size() - edit_undo_stack + 1;
-    stack.erase(stack.begin(), stack.begin() + oldImages);
-    top -= oldImages;
-  }
-  cel.img.detach();
-  stack.push_back(std::move(cel));
+  SCOPE_TIME("UndoStack::modify");
+  
+  assert(initialized);
+  steps.erase(steps.begin() + top, steps.end());
+  
+  Step &step = steps.emplace_back();
+  step.pos = current.pos;
+  step.size = current.img.size();
+  if (!tileable(current, cel)) {
+    step.cel = std::move(current);
+  } else if (!sameGeometry(current, cel) || current.img.constBits() != cel.img.constBits()) {
+    // The cel shares its pixels with the current state if it wasn't written to
+    step.tiles = diff(current, cel);
+  }
+  current = std::move(cel);
   ++top;
+  evict();
 }
 
 UndoState UndoStack::undo() {
-  assert(!stack.empty());
+  assert(initialized);
   if (top == 0) {
-    return {stack.front(), false};
+    return {current, false};
   }
   --top;
-  return {stack[top], true};
+  swap(steps[top]);
+  return {current, true};
 }
 
 UndoState UndoStack::redo() {
-  assert(!stack.empty());
-  if (top == stack.size() - 1) {
-    return {stack.back(), false};
+  assert(initialized);
+  if (top == steps.size()) {
+    return {current, false};
   }
+  swap(steps[top]);
   ++top;
-  return {stack[top], true};
+  return {current, true};
+}
+
+void UndoStack::countMemory(ImageMemory &memory) const {
+  memory.add(current.img);
+  for (const Step &step : steps) {
+    if (step.cel) {
+      memory.add(step.cel->img);
+    } else {
+      memory.addBytes(stepSize(step));
+    }
+  }
+}
+
+// The tiles of the before state that are not in the after state or differ
+// from it. The tiles are compressed on the thread pool.
+std::vector<UndoStack::Tile> UndoStack::diff(const CelImage &before, const CelImage &after) {
+  const QImage &image = before.img;
+  const QRect overlap = before.rect().intersected(after.rect()).translated(-before.pos);
+  const QPoint offset = before.pos - after.pos;
+  std::vector<Tile> tiles;
+  std::vector<std::shared_ptr<UndoTilePixels>> pixels;
+  for (int y = 0; y < image.height(); y += edit_undo_tile) {
+    for (int x = 0; x < image.width(); x += edit_undo_tile) {
+      const QRect rect = tileRect(image, {x, y});
+      if (overlap.contains(rect) && sameTile(image, after.img, rect, offset)) continue;
+      pixels.push_back(std::make_shared<UndoTilePixels>(readTile(image, rect)));
+      tiles.push_back({rect.topLeft(), pixels.back()});
+    }
+  }
+  compressTiles(pixels);
+  return tiles;
+}
+
+void UndoStack::swap(Step &step) {
+  SCOPE_TIME("UndoStack::swap");
+  
+  if (step.cel) {
+    std::swap(current, *step.cel);
+    return;
+  }
+  
+  if (step.pos != current.pos || step.size != current.img.size()) {
+    // Every pixel of the other state is either in one of the tiles or in the
+    // part that it has in common with the current state
+    CelImage other;
+    other.pos = step.pos;
+    other.img = QImage{step.size, current.img.format()};
+    copyOverlap(other, current);
+    for (const Tile &tile : step.tiles) {
+      writeTile(other.img, tileRect(other.img, tile.pos), tile.pixels->pixels());
+    }
+    step.tiles = diff(current, other);
+    step.pos = current.pos;
+    step.size = current.img.size();
+    current = std::move(other);
+    return;
+  }
+  
+  std::vector<std::shared_ptr<UndoTilePixels>> pixels;
+  for (Tile &tile : step.tiles) {
+    const QRect rect = tileRect(current.img, tile.pos);
+    const QByteArray other = tile.pixels->pixels();
+    tile.pixels = std::make_shared<UndoTilePixels>(readTile(current.img, rect));
+    writeTile(current.img, rect, other);
+    pixels.push_back(tile.pixels);
+  }
+  compressTiles(pixels);
+}
+
+// Tiles that are waiting to be compressed are counted at their uncompressed
+// size. If that is over the budget, the tiles are compressed now rather than
+// discarding steps that would fit once they are compressed.
+void UndoStack::evict() {
+  if (totalSize() > edit_undo_budget) compressPending();
+  
+  // The most recent step is always kept
+  std::size_t size = 0;
+  std::size_t drop = steps.size();
+  while (drop != 0) {
+    size += stepSize(steps[drop - 1]);
+    if (size > edit_undo_budget && drop != steps.size()) break;
+    --drop;
+  }
+  steps.erase(steps.begin(), steps.begin() + drop);
+  top -= drop;
+}
+
+void UndoStack::compressPending() {
+  SCOPE_TIME("UndoStack::compressPending");
+  
+  for (const Step &step : steps) {
+    for (const Tile &tile : step.tiles) {
+      if (tile.pixels->pending()) tile.pixels->compress();
+    }
+  }
+}
+
+std::size_t UndoStack::totalSize() const {
+  std::size_t size = 0;
+  for (const Step &step : steps) {
+    size += stepSize(step);
+  }
+  return size;
+}
+
+std::size_t UndoStack::stepSize(const Step &step) {
+  if (step.cel) {
+    return static_cast<std::size_t>(step.cel->img.sizeInBytes());
+  }
+  std::size_t size = 0;
+  for (const Tile &tile : step.tiles) {
+    size += tile.pixels->size();
+  }
+  return size;
 }
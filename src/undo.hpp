@@ -9,14 +9,25 @@
 #ifndef animera_undo_hpp
 #define animera_undo_hpp
 
+#include <deque>
+#include <memory>
 #include <vector>
+#include <optional>
 #include "cel.hpp"
+#include "image memory.hpp"
 
 struct UndoState {
   CelImage cel;
   bool undid;
 };
 
+class UndoTilePixels;
+
+/// An undo history for a single cel. Only the current state of the cel is
+/// stored in full. Each step stores the tiles that differ from the neighbouring
+/// state. The tiles are compressed on the thread pool. Undoing or redoing a
+/// step swaps its tiles with the tiles of the current state. The oldest steps
+/// are discarded when the steps use more memory than the budget.
 class UndoStack {
 public:
   UndoStack();
@@ -28,9 +39,37 @@ public:
   UndoState undo();
   UndoState redo();
   
+  void countMemory(ImageMemory &) const;
+  
 private:
-  std::vector<CelImage> stack;
-  std::size_t top;
+  struct Tile {
+    QPoint pos;
+    std::shared_ptr<UndoTilePixels> pixels;
+  };
+  
+  // The tiles are on the grid of the state that the step restores. A step
+  // that moves or resizes the cel also stores the tiles that are outside of
+  // the other state. A step that changes the format of the cel or makes it
+  // null stores the whole cel.
+  struct Step {
+    QPoint pos;
+    QSize size;
+    std::vector<Tile> tiles;
+    std::optional<CelImage> cel;
+  };
+  
+  // The steps before top have been applied to the current state
+  std::deque<Step> steps;
+  std::size_t top = 0;
+  CelImage current;
+  bool initialized = false;
+  
+  static std::vector<Tile> diff(const CelImage &, const CelImage &);
+  void swap(Step &);
+  void evict();
+  void compressPending();
+  std::size_t totalSize() const;
+  static std::size_t stepSize(const Step &);
 };
 
 #endif
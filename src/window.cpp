@@ -17,6 +17,7 @@
 #include "global font.hpp"
 #include "undo object.hpp"
 #include "config keys.hpp"
+#include "image memory.hpp"
 #include "error dialog.hpp"
 #include "config colors.hpp"
 #include "status object.hpp"
@@ -68,6 +69,33 @@ void Window::openFile(const QString &path) {
   } else {
     setWindowFilePath(path);
     setWindowModified(false);
+    autosave.setPath(path);
+    show();
+  }
+}
+
+void Window::recoverFile(const QString &path) {
+  if (Error err = anim.openFile(recoveryPath(path)); err) {
+    QDesktopWidget *desktop = static_cast<Application *>(QApplication::instance())->desktop();
+    (new ErrorDialog{desktop, "File recovery error", err.msg()})->open();
+    QFile::remove(recoveryPath(path));
+    openFile(path);
+  } else {
+    setWindowFilePath(path);
+    setWindowModified(true);
+    autosave.setPath(path);
+    show();
+  }
+}
+
+void Window::recoverUntitled(const QString &recovery) {
+  if (Error err = anim.openFile(recovery); err) {
+    QDesktopWidget *desktop = static_cast<Application *>(QApplication::instance())->desktop();
+    (new ErrorDialog{desktop, "File recovery error", err.msg()})->open();
+    QFile::remove(recovery);
+  } else {
+    setWindowModified(true);
+    autosave.setRecoveryPath(recovery);
     show();
   }
 }
@@ -83,6 +111,7 @@ void Window::openImage(const QString &path) {
 
 void Window::modify() {
   setWindowModified(true);
+  autosave.modify();
 }
 
 void Window::setPosition(const Window *previous) {
@@ -298,6 +327,7 @@ void Window::populateMenubar() {
   ADD_ACTION(file, "Open", key_open_file, *app, openFileDialog);
   ADD_ACTION(file, "Save", key_save_file, *this, saveFile);
   ADD_ACTION(file, "Save As", key_save_file_as, *this, saveFileDialog);
+  ADD_ACTION(file, "Save As Archive", {}, *this, saveArchiveDialog);
   ADD_ACTION(file, "Resize", {}, *this, resizeDialog);
   file->addSeparator();
   ADD_ACTION(file, "Export", key_export_file, *this, exportDialog);
@@ -307,6 +337,11 @@ void Window::populateMenubar() {
   // ADD_ACTION(file, "Import", QString{"CTRL+I"}, *this, exportDialog);
   ADD_ACTION(file, "Import Cel", key_import_cel, *this, importCelDialog);
   
+  QMenu *edit = menubar->addMenu("Edit");
+  edit->setFont(getGlobalFont());
+  ADD_ACTION(edit, "Undo", key_undo_edit, anim.timeline, undoEdit);
+  ADD_ACTION(edit, "Redo", key_redo_edit, anim.timeline, redoEdit);
+  
   QMenu *layer = menubar->addMenu("Layer");
   layer->setFont(getGlobalFont());
   ADD_ACTION(layer, "New Layer", key_new_layer, anim.timeline, insertLayer);
@@ -385,6 +420,7 @@ void Window::populateMenubar() {
   QMenu *help = menubar->addMenu("Help");
   help->setFont(getGlobalFont());
   ADD_ACTION(help, "Key Bindings", {}, *this, keysDialog);
+  ADD_ACTION(help, "Memory Usage", {}, *this, showMemory);
   
   menubar->adjustSize();
 }
@@ -397,6 +433,7 @@ void Window::connectSignals() {
   CONNECT(anim.timeline,   celImageChanged,              undo,          setCelImage);
   CONNECT(anim.timeline,   frameChanged,                 editor,        setFrame);
   CONNECT(anim.timeline,   celImageModified,             editor,        composite);
+  CONNECT(anim.timeline,   celImageChanged,              editor,        setCelImage);
   CONNECT(anim.timeline,   posChanged,                   timeline,      setPos);
   CONNECT(anim.timeline,   selectionChanged,             timeline,      setSelection);
   CONNECT(anim.timeline,   groupChanged,                 timeline,      setGroup);
@@ -499,17 +536,25 @@ void Window::connectSignals() {
   
   CONNECT(status,          shouldShowPerm,               statusBar,     showPerm);
   CONNECT(status,          shouldShowApnd,               statusBar,     showApnd);
+  
+  autosave.onError([this](const QString &msg) {
+    // The status bar only has room for the first line of the error
+    const std::string text = "Autosave failed: " + msg.section('\n', 0, 0).toStdString();
+    statusBar->showTemp(text);
+  });
 }
 
-void Window::saveToPath(const QString &path) {
+void Window::saveWithCompression(const QString &path, const CelCompression &compression) {
   anim.optimize();
-  if (Error err = anim.saveFile(path); err) {
+  if (Error err = anim.saveFile(path, compression); err) {
     auto *dialog = new ErrorDialog{this, "File save error", err.msg()};
     if (closeAfterSave) {
       CONNECT(dialog, finished, this, close);
     }
     dialog->open();
   } else {
+    autosave.discard();
+    autosave.setPath(path);
     setWindowFilePath(path);
     setWindowModified(false);
     statusBar->showTemp("Saved!");
@@ -519,6 +564,14 @@ void Window::saveToPath(const QString &path) {
   }
 }
 
+void Window::saveToPath(const QString &path) {
+  saveWithCompression(path, cel_compression_normal);
+}
+
+void Window::saveArchiveToPath(const QString &path) {
+  saveWithCompression(path, cel_compression_archive);
+}
+
 void Window::saveFile() {
   const QString path = windowFilePath();
   if (path.isEmpty()) {
@@ -542,6 +595,17 @@ void Window::saveFileDialog() {
   dialog->open();
 }
 
+void Window::saveArchiveDialog() {
+  auto *dialog = new QFileDialog{this};
+  dialog->setAttribute(Qt::WA_DeleteOnClose);
+  dialog->setAcceptMode(QFileDialog::AcceptSave);
+  dialog->setNameFilter("Animera Animation (*.animera)");
+  dialog->setDefaultSuffix("animera");
+  CONNECT(dialog, fileSelected, this, saveArchiveToPath);
+  updateDirSettings(dialog, pref_animation_dir);
+  dialog->open();
+}
+
 void Window::exportAnimation(const ExportParams &params) {
   if (Error err = exportTextureAtlas(params, anim); err) {
     (new ErrorDialog{this, "Export error", err.msg()})->open();
@@ -660,6 +724,15 @@ void Window::keysDialog() {
   dialog->open();
 }
 
+void Window::showMemory() {
+  ImageMemory memory;
+  anim.timeline.countMemory(memory);
+  undo->countMemory(memory);
+  const std::string text = "Memory: " + std::to_string(memory.actual() / 1024)
+    + " KB (" + std::to_string(memory.logical() / 1024) + " KB unshared)";
+  statusBar->showTemp(text);
+}
+
 void Window::resizeDialog() {
   auto *dialog = new ResizeCanvasDialog{this};
   CONNECT(dialog, canvasResized, anim, resizeCanvas);
@@ -681,6 +754,11 @@ void Window::closeEvent(QCloseEvent *event) {
     });
     quitter->open();
   } else {
+    // Unsaved changes are kept in the recovery file if the user wasn't asked
+    // whether to save them
+    if (!app->isClosing() || !isWindowModified()) {
+      autosave.discard();
+    }
     app->windowClosed(this);
   }
 }
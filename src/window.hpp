@@ -9,6 +9,7 @@
 #ifndef animera_window_hpp
 #define animera_window_hpp
 
+#include "autosave.hpp"
 #include "animation.hpp"
 #include <QtWidgets/qmainwindow.h>
 
@@ -37,6 +38,10 @@ public:
   
   void newFile(Format, QSize);
   void openFile(const QString &);
+  /// Open the recovery file of an animation file
+  void recoverFile(const QString &);
+  /// Open the recovery file of an animation that was never saved
+  void recoverUntitled(const QString &);
   void openImage(const QString &);
 
 private Q_SLOTS:
@@ -44,6 +49,7 @@ private Q_SLOTS:
 
 private:
   Animation anim;
+  Autosave autosave{anim};
   QWidget *central = nullptr;
   QWidget *bottom = nullptr;
   QWidget *right = nullptr;
@@ -71,9 +77,12 @@ private:
   void populateMenubar();
   void connectSignals();
   
+  void saveWithCompression(const QString &, const CelCompression &);
   void saveToPath(const QString &);
+  void saveArchiveToPath(const QString &);
   void saveFile();
   void saveFileDialog();
+  void saveArchiveDialog();
   void exportAnimation(const ExportParams &);
   void exportDialog();
   void exportFrame(const QString &);
@@ -88,6 +97,8 @@ private:
   void savePaletteDialog();
   void resetPalette();
   void keysDialog();
+  /// Show the memory used by the images of the animation and the undo history
+  void showMemory();
   void resizeDialog();
   
   void closeEvent(QCloseEvent *) override;
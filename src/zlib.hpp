@@ -31,7 +31,7 @@ struct InflateDeleter {
 
 inline Bytef *getZlibBuffer() {
   // TODO: std::make_unique_for_overwrite
-  static auto buffer = std::unique_ptr<Bytef[]>{new Bytef[file_buff_size]};
+  thread_local auto buffer = std::unique_ptr<Bytef[]>{new Bytef[file_buff_size]};
   return buffer.get();
 }
 
@@ -44,7 +44,12 @@ struct Context {
 */
 
 template <typename Context>
-Error zlibCompress(Context ctx, const bool raw = false) {
+Error zlibCompress(
+  Context ctx,
+  const bool raw = false,
+  const int level = Z_DEFAULT_COMPRESSION,
+  const int strategy = Z_DEFAULT_STRATEGY
+) {
   const uInt outBuffSize = file_buff_size;
   Bytef *outBuff = getZlibBuffer();
   
@@ -53,11 +58,11 @@ Error zlibCompress(Context ctx, const bool raw = false) {
   stream.zfree = nullptr;
   int ret = deflateInit2(
     &stream,
-    Z_DEFAULT_COMPRESSION,
+    level,
     Z_DEFLATED,
     raw ? -15 : 15,
     8,
-    Z_DEFAULT_STRATEGY
+    strategy
   );
   if (ret == Z_MEM_ERROR) return "zlib: memory error";
   assert(ret == Z_OK);
@@ -100,7 +105,7 @@ struct Context {
   bool hasInput();
   bool hasOutput();
   bool hasLastOutput();
-  uInt fillInputBuffer(Bytef *, uInt);
+  std::pair<const Bytef *, uInt> getInputBuffer();
   std::pair<Bytef *, uInt> getOutputBuffer();
   Error or void processOutputBuffer();
 };
@@ -108,9 +113,6 @@ struct Context {
 
 template <typename Context>
 Error zlibDecompress(Context ctx) {
-  const uInt inBuffSize = file_buff_size;
-  Bytef *inBuff = getZlibBuffer();
-  
   z_stream stream;
   stream.zalloc = nullptr;
   stream.zfree = nullptr;
@@ -130,9 +132,9 @@ Error zlibDecompress(Context ctx) {
   
   do {
     if (stream.avail_in == 0 && ctx.hasInput()) {
-      const uInt input = ctx.fillInputBuffer(inBuff, inBuffSize);
-      stream.next_in = inBuff;
-      stream.avail_in = input;
+      const std::pair<const Bytef *, uInt> input = ctx.getInputBuffer();
+      stream.next_in = input.first;
+      stream.avail_in = input.second;
     }
     
     if (stream.avail_out == 0 && ctx.hasOutput()) {
@@ -159,7 +161,7 @@ Error zlibDecompress(Context ctx) {
     if (stream.avail_out != 0) {
       return "zlib: extra data";
     }
-    ctx.processOutputBuffer();
+    TRY_VOID(ctx.processOutputBuffer());
   } else if (!ctx.hasOutput()) {
     if (stream.avail_out != outBuffSize) {
       return "zlib: extra data";